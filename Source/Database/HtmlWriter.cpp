@@ -0,0 +1,109 @@
+#include "HtmlWriter.h"
+
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+
+namespace LFL::Database {
+
+    HtmlWriter::HtmlWriter(std::FILE *sink, size_t capacity)
+        : sink_(sink)
+        , capacity_(capacity)
+    {
+        buffer_.reserve(capacity_);
+    }
+
+    HtmlWriter::~HtmlWriter()
+    {
+        try {
+            flush();
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    void HtmlWriter::flush()
+    {
+        if (sink_ == nullptr or buffer_.empty())
+            return;
+
+        if (std::fwrite(buffer_.data(), 1, buffer_.size(), sink_) !=
+            buffer_.size())
+            throw std::runtime_error("cannot write HTML output");
+        buffer_.clear();
+    }
+
+    void HtmlWriter::reserve(size_t size)
+    {
+        if (sink_ != nullptr and buffer_.size() + size > capacity_)
+            flush();
+    }
+
+    HtmlWriter &HtmlWriter::raw(std::string_view markup)
+    {
+        if (sink_ != nullptr and markup.size() >= capacity_) {
+            // Large blocks go to the file directly, no point in copying
+            flush();
+            if (std::fwrite(markup.data(), 1, markup.size(), sink_) !=
+                markup.size())
+                throw std::runtime_error("cannot write HTML output");
+            return *this;
+        }
+
+        reserve(markup.size());
+        buffer_.append(markup);
+        return *this;
+    }
+
+    HtmlWriter &HtmlWriter::text(std::string_view str)
+    {
+        size_t plain_from = 0;
+        for (size_t i = 0; i < str.size(); i++) {
+            std::string_view entity;
+            switch (str[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            case '\'': entity = "&#39;"; break;
+            default: continue;
+            }
+
+            raw(str.substr(plain_from, i - plain_from));
+            raw(entity);
+            plain_from = i + 1;
+        }
+        return raw(str.substr(plain_from));
+    }
+
+    HtmlWriter &HtmlWriter::number(int value)
+    {
+        char chars[16];
+        auto res = std::to_chars(chars, chars + sizeof(chars), value);
+        return raw(std::string_view(chars, res.ptr - chars));
+    }
+
+    HtmlWriter &HtmlWriter::number(double value)
+    {
+        char chars[32];
+        auto res = std::to_chars(
+            chars, chars + sizeof(chars), value, std::chars_format::general, 6);
+        return raw(std::string_view(chars, res.ptr - chars));
+    }
+
+    HtmlWriter &HtmlWriter::cell(std::string_view str)
+    {
+        return raw("\t\t<td>").text(str).raw("</td>\n");
+    }
+
+    HtmlWriter &HtmlWriter::cell(int value)
+    {
+        return raw("\t\t<td>").number(value).raw("</td>\n");
+    }
+
+    HtmlWriter &HtmlWriter::cell(double value)
+    {
+        return raw("\t\t<td>").number(value).raw("</td>\n");
+    }
+}  // namespace LFL::Database
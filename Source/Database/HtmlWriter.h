@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace LFL::Database {
+
+    /// Appends HTML to a reusable buffer. Numbers are formatted with
+    /// std::to_chars, text is escaped.
+    /// Without a sink everything is kept in memory, see str(). With a sink,
+    /// buffer is written to the file in bulk whenever it gets full.
+    class HtmlWriter {
+    public:
+        static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+        explicit HtmlWriter(std::FILE *sink = nullptr,
+                            size_t capacity = DEFAULT_CAPACITY);
+        /// Flushes remaining buffer to the sink
+        ~HtmlWriter();
+        HtmlWriter(const HtmlWriter &) = delete;
+        HtmlWriter &operator=(const HtmlWriter &) = delete;
+
+        /// Appends markup as is
+        HtmlWriter &raw(std::string_view markup);
+        /// Appends text, escaping HTML special characters
+        HtmlWriter &text(std::string_view str);
+        HtmlWriter &number(int value);
+        /// Same format as std::ostream with default flags (%g)
+        HtmlWriter &number(double value);
+
+        /// Appends "\t\t<td>value</td>\n"
+        HtmlWriter &cell(std::string_view str);
+        HtmlWriter &cell(int value);
+        HtmlWriter &cell(double value);
+
+        /// Writes buffer to the sink, does nothing without sink.
+        /// \throws std::runtime_error if writing fails
+        void flush();
+
+        /// \returns everything written so far, when there is no sink
+        const std::string &str() const { return buffer_; }
+
+    private:
+        /// Makes room for at least \p size more characters
+        void reserve(size_t size);
+
+        std::FILE *sink_;
+        size_t capacity_;
+        std::string buffer_;
+    };
+}  // namespace LFL::Database
@@ -0,0 +1,455 @@
+#include "League.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#include "Utils/Timing.h"
+
+namespace LFL::Database {
+
+    LeagueState::LeagueState(Storage &storage)
+    {
+        using namespace sqlite_orm;
+
+        for (auto &team : storage.get_all<MTeam>()) {
+            next_team_id_ = std::max(next_team_id_, team.id + 1);
+            team_id_by_name_[team.name] = team.id;
+            teams_.emplace(team.id, std::move(team));
+        }
+        for (auto &player : storage.get_all<MPlayer>()) {
+            next_player_id_ = std::max(next_player_id_, player.id + 1);
+            players_[player.team_id].insert(std::move(player));
+        }
+        for (auto &team_players : players_) {
+            team_players.second.clear_changed();
+        }
+        for (auto &row : storage.select(
+                 columns(&MMatchHistory::team_id, &MMatchHistory::date))) {
+            history_.emplace(std::get<0>(row), std::move(std::get<1>(row)));
+        }
+
+        flushed_team_id_ = next_team_id_ - 1;
+        flushed_player_id_ = next_player_id_ - 1;
+
+        std::cout << "Loaded " << teams_.size() << " teams and "
+                  << history_.size() / 2 << " games" << std::endl;
+    }
+
+    bool LeagueState::has_changes() const
+    {
+        return !dirty_teams_.empty() or !dirty_team_players_.empty() or
+               !new_history_.empty();
+    }
+
+    void LeagueState::flush(Storage &storage)
+    {
+        using namespace sqlite_orm;
+
+        // Rows created after the last flush already have ids, replace()
+        // inserts them with those ids.
+        for (int id : dirty_teams_) {
+            const auto &team = teams_.at(id);
+            if (id > flushed_team_id_) {
+                storage.replace(team);
+            }
+            else {
+                storage.update(team);
+            }
+        }
+
+        if (!dirty_team_players_.empty()) {
+            // Only changed players are written, each by one of two
+            // statements, prepared once and bound to the row buffer
+            MPlayer row;
+            auto insert_player = storage.prepare(replace(std::ref(row)));
+            auto update_player = storage.prepare(update(std::ref(row)));
+
+            for (int team_id : dirty_team_players_) {
+                players_.at(team_id).for_each_changed(
+                    [&](const MPlayer &player) {
+                        row = player;
+                        if (player.id > flushed_player_id_) {
+                            storage.execute(insert_player);
+                        }
+                        else {
+                            storage.execute(update_player);
+                        }
+                    });
+            }
+            for (int team_id : dirty_team_players_) {
+                players_.at(team_id).clear_changed();
+            }
+        }
+
+        if (!new_history_.empty()) {
+            storage.insert_range(new_history_.begin(), new_history_.end());
+        }
+
+        // Report sections rendered from these tables are outdated now
+        if (!dirty_teams_.empty())
+            bump_table_generation(storage, "teams");
+        if (!dirty_team_players_.empty())
+            bump_table_generation(storage, "players");
+
+        dirty_teams_.clear();
+        dirty_team_players_.clear();
+        new_history_.clear();
+        flushed_team_id_ = next_team_id_ - 1;
+        flushed_player_id_ = next_player_id_ - 1;
+    }
+
+    MTeam &LeagueState::get_or_create_team(std::string_view name)
+    {
+        auto it = team_id_by_name_.find(std::string(name));
+        if (it != team_id_by_name_.end())
+            return teams_.at(it->second);
+
+        // create
+        MTeam new_team{
+            next_team_id_++,
+            std::string(name),
+            0,  // games
+            0,  // wins
+            0,  // loses
+            0,  // wins_ot
+            0,  // loses_ot
+            0,  // points
+            0,  // goal_for
+            0,  // goal_again
+            0,  // sun_of_att
+        };
+
+        team_id_by_name_[new_team.name] = new_team.id;
+        dirty_teams_.insert(new_team.id);
+        return teams_.emplace(new_team.id, std::move(new_team)).first->second;
+    }
+
+    bool LeagueState::is_match_in_history(int team_id,
+                                          const std::string &date) const
+    {
+        return history_.count(std::make_pair(team_id, date)) != 0;
+    }
+
+    MPlayer &TeamPlayers::insert(MPlayer player)
+    {
+        const int number = player.number;
+        if (number < 0 or number > MAX_NUMBER)
+            throw std::out_of_range("player number " + std::to_string(number) +
+                                    " is out of range");
+
+        if (number >= number_limit()) {
+            slots_.resize(number + 1);
+            changed_.resize(number + 1);
+        }
+        slots_[number] = std::move(player);
+        mark_changed(number);
+        return slots_[number];
+    }
+
+    TeamPlayers &LeagueState::get_or_create_team_players(
+        int team_id,
+        const XMLParser::Data::Team &team)
+    {
+        auto &res = players_[team_id];
+
+        for (const auto &xml_player : team.players) {
+            if (xml_player.number < 0 or
+                xml_player.number > TeamPlayers::MAX_NUMBER) {
+                std::cout << "\tPlayer number " << xml_player.number << " of "
+                          << team.name << " is out of range, ignoring player"
+                          << std::endl;
+                continue;
+            }
+            if (res.find(xml_player.number) == nullptr) {
+                // create new player
+                MPlayer new_player{
+                    next_player_id_++,
+                    xml_player.number,
+                    std::string(xml_player.name),
+                    std::string(xml_player.surname),
+                    team_id,
+                    xml_player.p_type,
+                    0,  // games
+                    0,  // seconds on the field
+                    0,  // yellow cards
+                    0,  // read cards
+                    0,  // goals
+                    0,  // assists
+                    0,  // goals from penalty
+                    0,  // goals got as goalkeeper
+                };
+
+                res.insert(std::move(new_player));
+            }
+        }
+
+        return res;
+    }
+
+    std::vector<FieldTime> sweep_field_time(
+        const XMLParser::Data::Team &our_team,
+        const XMLParser::Data::Team &en_team,
+        const TeamPlayers &players,
+        int match_lenght)
+    {
+        // Indexed by number, slots of unknown numbers are never used
+        std::vector<FieldTime> res(players.number_limit());
+        for (int number : our_team.starting_players) {
+            if (players.find(number) != nullptr)
+                res[number].playing = true;
+        }
+
+        std::vector<const XMLParser::Data::Substitution *> subs;
+        subs.reserve(our_team.subsitutions.size());
+        for (const auto &sub : our_team.subsitutions) {
+            subs.push_back(&sub);
+        }
+        std::stable_sort(subs.begin(),
+                         subs.end(),
+                         [](const auto *a, const auto *b) {
+                             return a->time < b->time;
+                         });
+
+        // Goal at the very start is outside of every interval
+        std::vector<int> goal_times;
+        goal_times.reserve(en_team.goals.size());
+        for (const auto &goal : en_team.goals) {
+            if (goal.time > 0)
+                goal_times.push_back(goal.time);
+        }
+        std::sort(goal_times.begin(), goal_times.end());
+
+        auto leave = [&res, &players](int number, int time, int goals) {
+            if (players.find(number) == nullptr)
+                return;
+            auto &p = res[number];
+            assert(p.playing);
+            p.seconds += time - p.since;
+            p.goals_against += goals - p.goals_at_since;
+            p.playing = false;
+        };
+        auto enter = [&res, &players](int number, int time, int goals) {
+            if (players.find(number) == nullptr)
+                return;
+            auto &p = res[number];
+            assert(p.playing == false);
+            p.playing = true;
+            p.since = time;
+            p.goals_at_since = goals;
+        };
+
+        size_t goals = 0;
+        for (const auto *sub : subs) {
+            while (goals < goal_times.size() and goal_times[goals] <= sub->time)
+                goals++;
+
+            leave(sub->p_out, sub->time, int(goals));
+            if (sub->p_in != sub->p_out)
+                enter(sub->p_in, sub->time, int(goals));
+        }
+
+        // Players on the field played till the end
+        for (int number = 0; number < int(res.size()); number++) {
+            if (res[number].playing)
+                leave(number, match_lenght, int(goal_times.size()));
+        }
+
+        return res;
+    }
+
+    bool LeagueState::apply(const LFL::XMLParser::Data::Game &game)
+    {
+        assert(game.teams.size() == 2);
+        const auto &team1_data = game.teams[0];
+        const auto &team2_data = game.teams[1];
+
+        Utils::ScopedTimer lookup_timer(Utils::Stage::TEAM_LOOKUP);
+        MTeam &team1 = get_or_create_team(team1_data.name);
+        MTeam &team2 = get_or_create_team(team2_data.name);
+        const std::string date(game.date);
+        lookup_timer.stop();
+
+        std::cout << team1.name << " vs " << team2.name << " (" << game.date
+                  << " @ " << game.place << ")" << std::endl;
+
+        Utils::ScopedTimer history_timer(Utils::Stage::HISTORY_CHECK);
+        if (is_match_in_history(team1.id, date)) {
+            std::cout << "\tAlready processed this match! Ignoring\n";
+            return false;
+        }
+        else {  // Add to history
+            std::cout << "\tProcessing!" << std::endl;
+
+            // Only first team is checked, second one may already have a
+            // game on this date, it is recorded once
+            for (int team_id : {team1.id, team2.id}) {
+                if (history_.emplace(team_id, date).second)
+                    new_history_.push_back(MMatchHistory{-1, team_id, date});
+            }
+        }
+        history_timer.stop();
+
+        Utils::ScopedTimer stats_timer(Utils::Stage::STATS);
+
+        // update games
+        team1.games += 1;
+        team2.games += 1;
+
+        // update attendance
+        team1.sum_of_attendance += game.attendance;
+        team2.sum_of_attendance += game.attendance;
+
+        // Update goal_for goal_against
+        team1.goals_for += team1_data.goals.size();
+        team2.goals_again += team1_data.goals.size();
+        team2.goals_for += team2_data.goals.size();
+        team1.goals_again += team2_data.goals.size();
+
+        // Finished in main time, or had overtimes?
+        const int MAIN_TIME = 60 * 60;  // 60m
+
+        int last_goal = 0;
+        for (const auto &x : team1_data.goals) {
+            last_goal = std::max(last_goal, x.time);
+        }
+        for (const auto &x : team2_data.goals) {
+            last_goal = std::max(last_goal, x.time);
+        }
+        bool overtime = last_goal > MAIN_TIME;
+
+        // Overtime end at the exact moment someone score goal
+        int match_lenght = std::max(MAIN_TIME, last_goal);
+
+        if (team1_data.goals.size() > team2_data.goals.size()) {
+            // team1 won
+            if (overtime) {
+                team1.wins_in_overtime += 1;
+                team1.points += 3;
+                team2.loses_in_overtime += 1;
+                team2.points += 2;
+            }
+            else {
+                team1.wins += 1;
+                team1.points += 5;
+                team2.loses += 1;
+                team2.points += 1;
+            }
+        }
+        else {
+            // team2 won
+            if (overtime) {
+                team2.wins_in_overtime += 1;
+                team2.points += 3;
+                team1.loses_in_overtime += 1;
+                team1.points += 2;
+            }
+            else {
+                team2.wins += 1;
+                team2.points += 5;
+                team1.loses += 1;
+                team1.points += 1;
+            }
+        }
+
+        dirty_teams_.insert(team1.id);
+        dirty_teams_.insert(team2.id);
+
+        std::cout << "\tTeam data updated!" << std::endl;
+        stats_timer.stop();
+
+        process_players(team1_data, team2_data, team1.id, match_lenght);
+        std::cout << "\tFirst team players updated!" << std::endl;
+        process_players(team2_data, team1_data, team2.id, match_lenght);
+        std::cout << "\tSecond team players updated!" << std::endl;
+
+        return true;
+    }
+
+    void LeagueState::process_players(const XMLParser::Data::Team &our_team,
+                                      const XMLParser::Data::Team &en_team,
+                                      int team_id,
+                                      int match_lenght)
+    {
+        Utils::ScopedTimer load_timer(Utils::Stage::PLAYER_LOAD);
+        auto &players = get_or_create_team_players(team_id, our_team);
+        load_timer.stop();
+
+        Utils::ScopedTimer stats_timer(Utils::Stage::STATS);
+
+        // Events may refer to numbers missing from the roster, those are
+        // reported and ignored
+        auto find_player = [&players, &our_team](int number) {
+            MPlayer *player = players.find(number);
+            if (player == nullptr) {
+                std::cout << "\tUnknown player " << number << " of "
+                          << our_team.name << ", ignoring event" << std::endl;
+            }
+            else {
+                players.mark_changed(number);
+            }
+            return player;
+        };
+
+        {  // yellow and red cards
+            std::vector<bool> yellow_cards(players.number_limit());
+            for (const auto &pen : our_team.penalties) {
+                MPlayer *player = find_player(pen.number);
+                if (player == nullptr)
+                    continue;
+
+                if (yellow_cards[pen.number]) {
+                    player->red_cards += 1;
+                    player->yellow_cards -= 1;
+                }
+                else {
+                    player->yellow_cards += 1;
+                    yellow_cards[pen.number] = true;
+                }
+            }
+        }
+        {  // goals and assists
+            for (const auto &goal : our_team.goals) {
+                if (MPlayer *player = find_player(goal.number)) {
+                    if (goal.from_game) {
+                        player->goals += 1;
+                    }
+                    else {
+                        player->goal_from_penalty += 1;
+                    }
+                }
+
+                for (int a : goal.assists) {
+                    if (MPlayer *player = find_player(a))
+                        player->assists += 1;
+                }
+            }
+        }
+
+        {  // games player and minutes on the field (and
+           // goalkeper_got_scores)
+            const auto field_time =
+                sweep_field_time(our_team, en_team, players, match_lenght);
+            players.for_each([&field_time, &players](MPlayer &player) {
+                const auto &time = field_time[player.number];
+
+                if (player.p_type == XMLParser::Data::PlayerType::GOALKEEPER and
+                    time.goals_against != 0) {
+                    player.goalkeper_got_scores += time.goals_against;
+                    players.mark_changed(player.number);
+                }
+
+                // Player played the game, iff they were at least one second
+                // in the game
+                if (time.seconds > 0) {
+                    player.games += 1;
+                    player.seconds_on_field += time.seconds;
+                    players.mark_changed(player.number);
+                }
+            });
+        }
+
+        if (players.has_changed())
+            dirty_team_players_.insert(team_id);
+    }
+}  // namespace LFL::Database
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Models.h"
+
+namespace LFL::Database {
+
+    /// Players of one team, indexed by jersey number. Numbers are small, so
+    /// players are kept in flat vector, with empty slots for unused numbers.
+    class TeamPlayers {
+    public:
+        /// Highest accepted jersey number
+        static constexpr int MAX_NUMBER = 999;
+
+        /// \returns player with the number, nullptr if there is none
+        MPlayer *find(int number)
+        {
+            if (number < 0 or number >= number_limit() or
+                slots_[number].id == 0)
+                return nullptr;
+            return &slots_[number];
+        }
+        const MPlayer *find(int number) const
+        {
+            return const_cast<TeamPlayers *>(this)->find(number);
+        }
+
+        /// Puts player to its number slot, player is marked as changed
+        /// \throws std::out_of_range if number is not in [0; MAX_NUMBER]
+        MPlayer &insert(MPlayer player);
+
+        /// Marks player as changed since the last flush
+        void mark_changed(int number)
+        {
+            if (!changed_[number]) {
+                changed_[number] = true;
+                changed_numbers_.push_back(number);
+            }
+        }
+        /// Calls f(const MPlayer &) for every changed player
+        template<typename F>
+        void for_each_changed(F f) const
+        {
+            for (int number : changed_numbers_) {
+                f(slots_[number]);
+            }
+        }
+        /// \returns true if some player was changed since the last flush
+        bool has_changed() const { return !changed_numbers_.empty(); }
+        void clear_changed()
+        {
+            for (int number : changed_numbers_) {
+                changed_[number] = false;
+            }
+            changed_numbers_.clear();
+        }
+
+        /// \returns all numbers are below this
+        int number_limit() const { return static_cast<int>(slots_.size()); }
+
+        /// Calls f(MPlayer &) for every player, in order of numbers
+        template<typename F>
+        void for_each(F f)
+        {
+            for (auto &p : slots_) {
+                if (p.id != 0)
+                    f(p);
+            }
+        }
+
+    private:
+        /// Empty slots have id 0
+        std::vector<MPlayer> slots_;
+        std::vector<bool> changed_;
+        std::vector<int> changed_numbers_;
+    };
+
+    /// Time on the field of one player, and goals the enemy scored during it
+    struct FieldTime {
+        bool playing = false;
+        /// When player entered the field, and how many enemy goals there were
+        /// at that moment
+        int since = 0;
+        int goals_at_since = 0;
+
+        int seconds = 0;
+        int goals_against = 0;
+    };
+
+    /// Computes field time of every player in one pass over substitutions and
+    /// enemy goals, merged by time.
+    /// Enemy goal counts against player if it happened in half-open
+    /// interval (entered; left], so at equal time goals go before
+    /// substitutions.
+    /// \returns field time indexed by player number, numbers missing from
+    /// players are ignored
+    std::vector<FieldTime> sweep_field_time(
+        const XMLParser::Data::Team &our_team,
+        const XMLParser::Data::Team &en_team,
+        const TeamPlayers &players,
+        int match_lenght);
+
+    /// In memory copy of teams, players and match history. It is loaded from
+    /// database once, updated by every processed game, and only rows changed
+    /// since the last flush are written back.
+    class LeagueState {
+    public:
+        /// Loads all tables from the storage
+        explicit LeagueState(Storage &storage);
+
+        /// Records game statistics.
+        /// \returns false if game was already processed
+        bool apply(const LFL::XMLParser::Data::Game &game);
+
+        /// Writes new and changed rows to the storage. Does not open
+        /// transaction itself.
+        void flush(Storage &storage);
+
+        /// \returns true if there are changes not yet written to the storage
+        bool has_changes() const;
+
+    private:
+        MTeam &get_or_create_team(std::string_view name);
+        bool is_match_in_history(int team_id, const std::string &date) const;
+        /// \returns players of the team, with players of the game added.
+        /// Players with numbers out of [0; TeamPlayers::MAX_NUMBER] are
+        /// reported and ignored, as their events are.
+        TeamPlayers &get_or_create_team_players(
+            int team_id,
+            const XMLParser::Data::Team &team);
+        void process_players(const XMLParser::Data::Team &our_team,
+                             const XMLParser::Data::Team &en_team,
+                             int team_id,
+                             int match_lenght);
+
+        /// [id -> MTeam], node based so references stay valid
+        std::map<int, MTeam> teams_;
+        std::unordered_map<std::string, int> team_id_by_name_;
+        /// [team_id -> players]
+        std::unordered_map<int, TeamPlayers> players_;
+        std::set<std::pair<int, std::string>> history_;
+
+        /// Rows with id above these were created after the last flush
+        int flushed_team_id_ = 0;
+        int flushed_player_id_ = 0;
+        int next_team_id_ = 1;
+        int next_player_id_ = 1;
+
+        std::set<int> dirty_teams_;
+        /// Teams whose players were changed, see TeamPlayers::mark_changed
+        std::set<int> dirty_team_players_;
+        std::vector<MMatchHistory> new_history_;
+    };
+}  // namespace LFL::Database
@@ -0,0 +1,37 @@
+#include "Manifest.h"
+
+#include <vector>
+
+namespace LFL::Database {
+
+    FileManifest::FileManifest(Storage &storage)
+    {
+        for (auto &file : storage.get_all<MIngestedFile>()) {
+            std::string path = file.path;
+            files_.emplace(std::move(path), std::move(file));
+        }
+    }
+
+    const MIngestedFile *FileManifest::find(const std::string &path) const
+    {
+        auto it = files_.find(path);
+        return it != files_.end() ? &it->second : nullptr;
+    }
+
+    void FileManifest::record(const MIngestedFile &file)
+    {
+        files_[file.path] = file;
+        changed_.insert(file.path);
+    }
+
+    void FileManifest::flush(Storage &storage)
+    {
+        std::vector<MIngestedFile> rows;
+        rows.reserve(changed_.size());
+        for (const auto &path : changed_) {
+            rows.push_back(files_.at(path));
+        }
+        storage.replace_range(rows.begin(), rows.end());
+        changed_.clear();
+    }
+}  // namespace LFL::Database
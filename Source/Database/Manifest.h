@@ -0,0 +1,63 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include "Models.h"
+
+namespace LFL::Database {
+
+    /// Files already recorded in the database, with their size, last write
+    /// time and hash of contents, so unchanged files can be skipped before
+    /// they are parsed.
+    class FileManifest {
+    public:
+        /// Loads all recorded files from the storage
+        explicit FileManifest(Storage &storage);
+
+        /// \returns recorded state of the file, nullptr if it was never
+        /// recorded
+        const MIngestedFile *find(const std::string &path) const;
+        /// Records (or updates) state of the file, written to the storage
+        /// by flush().
+        void record(const MIngestedFile &file);
+
+        /// Decides if file has to be processed. File recorded with the same
+        /// size and last write time is unchanged. If only the time differs
+        /// (file was copied or touched), contents hash decides, and new
+        /// time of unchanged file is recorded.
+        /// \param file current path, size and last write time, hash is
+        /// filled in if it was computed
+        /// \param hash returns Utils::hash64 of file contents, called only
+        /// if needed
+        /// \returns true if file is new or changed
+        template<typename Hash>
+        bool is_changed(MIngestedFile &file, Hash hash)
+        {
+            const auto *known = find(file.path);
+            if (known == nullptr or known->size != file.size)
+                return true;
+            if (known->mtime == file.mtime)
+                return false;
+
+            file.hash = hash();
+            if (known->hash != file.hash)
+                return true;
+            record(file);
+            return false;
+        }
+
+        /// Writes recorded files to the storage. Does not open transaction
+        /// itself.
+        void flush(Storage &storage);
+
+        /// \returns true if there are files not yet written to the storage
+        bool has_changes() const { return !changed_.empty(); }
+
+    private:
+        /// [path -> file]
+        std::unordered_map<std::string, MIngestedFile> files_;
+        std::set<std::string> changed_;
+    };
+}  // namespace LFL::Database
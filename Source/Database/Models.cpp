@@ -1,355 +1,192 @@
 #include "Models.h"
 
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <memory>
 #include <set>
+#include <stdexcept>
+
+#include "HtmlWriter.h"
+#include "League.h"
+#include "Manifest.h"
+#include "Utils/Timing.h"
 
 namespace LFL::Database {
 
-    auto create_database_connection()
+    /// \returns true if database file exists and already has the index.
+    /// sqlite_orm syncs indices with CREATE INDEX IF NOT EXISTS and does
+    /// not report them, so sqlite_master is queried directly.
+    static bool has_index(const std::string &filename, const char *index)
     {
-        using namespace sqlite_orm;
-        auto storage = make_storage(
-            "lfl.sqlite",
-            make_table(
-                "teams",
-                make_column("id", &MTeam::id, primary_key()),
-                make_column("name", &MTeam::name),
-                make_column("games", &MTeam::games),
-                make_column("wins", &MTeam::wins),
-                make_column("loses", &MTeam::loses),
-                make_column("wins_in_overtime", &MTeam::wins_in_overtime),
-                make_column("loses_in_overtime", &MTeam::loses_in_overtime),
-                make_column("points", &MTeam::points),
-                make_column("goals_for", &MTeam::goals_for),
-                make_column("goals_again", &MTeam::goals_again),
-                make_column("sum_of_attendance", &MTeam::sum_of_attendance)),
-            make_table(
-                "players",
-                make_column("id", &MPlayer::id, primary_key()),
-                make_column("number", &MPlayer::number),
-                make_column("name", &MPlayer::name),
-                make_column("surname", &MPlayer::surname),
-                make_column("team_id", &MPlayer::team_id),
-                make_column("p_type", &MPlayer::p_type),
-                make_column("games", &MPlayer::games),
-                make_column("seconds_on_field", &MPlayer::seconds_on_field),
-                make_column("yellow_cards", &MPlayer::yellow_cards),
-                make_column("red_cards", &MPlayer::red_cards),
-                make_column("goals", &MPlayer::goals),
-                make_column("assists", &MPlayer::assists),
-                make_column("goal_from_penalty", &MPlayer::goal_from_penalty),
-                make_column("goalkeper_got_scores",
-                            &MPlayer::goalkeper_got_scores)),
-            make_table("history",
-                       make_column("id", &MMatchHistory::id, primary_key()),
-                       make_column("team_id", &MMatchHistory::team_id),
-                       make_column("date", &MMatchHistory::date)));
-        storage.sync_schema();
-        return storage;
-    }
-
-    void process_game_info(const LFL::XMLParser::Data::Game &game)
+        sqlite3 *db = nullptr;
+        bool res = false;
+        if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READONLY,
+                            nullptr) == SQLITE_OK) {
+            sqlite3_stmt *stmt = nullptr;
+            if (sqlite3_prepare_v2(db,
+                                   "SELECT 1 FROM sqlite_master WHERE "
+                                   "type = 'index' AND name = ?",
+                                   -1,
+                                   &stmt,
+                                   nullptr) == SQLITE_OK) {
+                sqlite3_bind_text(stmt, 1, index, -1, SQLITE_STATIC);
+                res = sqlite3_step(stmt) == SQLITE_ROW;
+            }
+            sqlite3_finalize(stmt);
+        }
+        sqlite3_close(db);
+        return res;
+    }
+
+    /// Databases written before history(team_id, date) became unique may
+    /// have the second team of a game recorded twice. Keeps the first of
+    /// equal rows, so the unique index can be created. One-time migration,
+    /// it is skipped once the index exists.
+    static void remove_duplicate_history(Storage &storage,
+                                         const std::string &filename)
     {
         using namespace sqlite_orm;
+        if (has_index(filename, "idx_history_team_date") or
+            !storage.table_exists("history"))
+            return;
 
-        auto storage = create_database_connection();
-
-        auto get_or_create_team = [&storage](const std::string &name) {
-            auto team = storage.get_all<MTeam>(where(c(&MTeam::name) == name));
-
-            if (team.size() == 0) {
-                // create
-                MTeam new_team{
-                    -1,
-                    name,
-                    0,  // games
-                    0,  // wins
-                    0,  // loses
-                    0,  // wins_ot
-                    0,  // loses_ot
-                    0,  // points
-                    0,  // goal_for
-                    0,  // goal_again
-                    0,  // sun_of_att
-                };
-
-                //  insert returns inserted id
-                new_team.id = storage.insert(new_team);
-                return new_team;
-            }
-            else {
-                assert(team.size() == 1);
-                return team[0];
-            }
-        };
-
-        auto is_match_in_history = [&storage](int team_id,
-                                              const std::string &date) {
-            auto mh = storage.get_all<MMatchHistory>(
-                where(c(&MMatchHistory::team_id) == team_id and
-                      c(&MMatchHistory::date) == date));
-            return mh.size() == 1;
-        };
-
-        auto get_or_create_team_players =
-            [&storage](int team_id,
-                       const std::vector<XMLParser::Data::Player> &players) {
-                std::map<int, MPlayer> res;
-
-                auto team_p = storage.get_all<MPlayer>(
-                    where(c(&MPlayer::team_id) == team_id));
-
-                for (auto p : team_p) {
-                    res[p.number] = p;
-                }
-
-                storage.transaction([&] {
-                    for (const auto &xml_player : players) {
-                        if (res.count(xml_player.number) == 0) {
-                            // create new player
-                            MPlayer new_player{
-                                -1,
-                                xml_player.number,
-                                xml_player.name,
-                                xml_player.surname,
-                                team_id,
-                                xml_player.p_type,
-                                0,  // games
-                                0,  // seconds on the field
-                                0,  // yellow cards
-                                0,  // read cards
-                                0,  // goals
-                                0,  // assists
-                                0,  // goals from penalty
-                                0,  // goals got as goalkeeper
-                            };
-
-                            new_player.id = storage.insert(new_player);
-
-                            res[new_player.number] = new_player;
-                        }
-                    }
-
-                    return true;  // commit
-                });
-
-                return res;
-            };
+        storage.remove_all<MMatchHistory>(where(not_in(
+            &MMatchHistory::id,
+            select(min(&MMatchHistory::id),
+                   group_by(&MMatchHistory::team_id, &MMatchHistory::date)))));
+    }
 
-        assert(game.teams.size() == 2);
-        const auto &team1_data = game.teams[0];
-        const auto &team2_data = game.teams[1];
+    Session::Session(const std::string &filename)
+        : storage(make_database_storage(filename))
+    {
+        remove_duplicate_history(storage, filename);
+        // Columns removed from the scheme (e.g. stored ranking values of
+        // older databases) are dropped by copying the table, not by
+        // recreating it empty
+        storage.sync_schema(true);
+        // keep single connection for whole session, instead of reopening
+        // database file for every query
+        storage.open_forever();
+    }
 
-        MTeam team1 = get_or_create_team(team1_data.name);
-        MTeam team2 = get_or_create_team(team2_data.name);
+    Session::~Session() = default;
 
-        std::cout << team1.name << " vs " << team2.name << " (" << game.date
-                  << " @ " << game.place << ")" << std::endl;
+    LeagueState &Session::league()
+    {
+        if (!league_)
+            league_ = std::make_unique<LeagueState>(storage);
+        return *league_;
+    }
 
-        if (is_match_in_history(team1.id, game.date)) {
-            std::cout << "\tAlready processed this match! Ignoring\n";
-            return;
-        }
-        else {  // Add to history
-            std::cout << "\tProcessing!" << std::endl;
+    FileManifest &Session::manifest()
+    {
+        if (!manifest_)
+            manifest_ = std::make_unique<FileManifest>(storage);
+        return *manifest_;
+    }
 
-            MMatchHistory mh1{-1, team1.id, game.date};
-            storage.insert(mh1);
+    void Session::flush()
+    {
+        const bool league_changed = league_ and league_->has_changes();
+        const bool manifest_changed = manifest_ and manifest_->has_changes();
+        if (!league_changed and !manifest_changed)
+            return;
 
-            MMatchHistory mh2{-1, team2.id, game.date};
-            storage.insert(mh2);
-        }
+        Utils::ScopedTimer timer(Utils::Stage::COMMIT);
+        auto guard = storage.transaction_guard();
+        if (league_changed)
+            league_->flush(storage);
+        if (manifest_changed)
+            manifest_->flush(storage);
+        guard.commit();
+    }
 
-        // update games
-        team1.games += 1;
-        team2.games += 1;
+    void Session::discard_changes()
+    {
+        // Reloaded from database on next use
+        league_.reset();
+        manifest_.reset();
+    }
 
-        // update attendance
-        team1.sum_of_attendance += game.attendance;
-        team2.sum_of_attendance += game.attendance;
+    int table_generation(Storage &storage, const std::string &table)
+    {
+        auto row = storage.get_pointer<MTableGeneration>(table);
+        return row ? row->generation : 0;
+    }
 
-        // Update goal_for goal_against
-        team1.goals_for += team1_data.goals.size();
-        team2.goals_again += team1_data.goals.size();
-        team2.goals_for += team2_data.goals.size();
-        team1.goals_again += team2_data.goals.size();
+    void bump_table_generation(Storage &storage, const std::string &table)
+    {
+        storage.replace(
+            MTableGeneration{table, table_generation(storage, table) + 1});
+    }
 
-        // Finished in main time, or had overtimes?
-        const int MAIN_TIME = 60 * 60;  // 60m
+    IngestBatch::IngestBatch(Session &session, size_t games_per_commit)
+        : session_(session)
+        , games_per_commit_(games_per_commit)
+    {
+    }
 
-        int last_goal = 0;
-        for (const auto &x : team1_data.goals) {
-            last_goal = std::max(last_goal, x.time);
-        }
-        for (const auto &x : team2_data.goals) {
-            last_goal = std::max(last_goal, x.time);
+    IngestBatch::~IngestBatch()
+    {
+        if (games_in_batch_ != 0) {
+            // Not committed (exception while processing), drop everything
+            // after last checkpoint.
+            session_.discard_changes();
         }
-        bool overtime = last_goal > MAIN_TIME;
-
-        // Overtime end at the exact moment someone score goal
-        int match_lenght = std::max(MAIN_TIME, last_goal);
-
-        if (team1_data.goals.size() > team2_data.goals.size()) {
-            // team1 won
-            if (overtime) {
-                team1.wins_in_overtime += 1;
-                team1.points += 3;
-                team2.loses_in_overtime += 1;
-                team2.points += 2;
-            }
-            else {
-                team1.wins += 1;
-                team1.points += 5;
-                team2.loses += 1;
-                team2.points += 1;
-            }
+    }
+
+    void IngestBatch::add(const LFL::XMLParser::Data::Game &game)
+    {
+        record(game, nullptr);
+    }
+
+    void IngestBatch::add(const LFL::XMLParser::Data::Game &game,
+                          const MIngestedFile &source)
+    {
+        record(game, &source);
+    }
+
+    void IngestBatch::record(const LFL::XMLParser::Data::Game &game,
+                             const MIngestedFile *source)
+    {
+        try {
+            // Recorded first, so the checkpoint below includes it
+            if (source != nullptr)
+                session_.manifest().record(*source);
+            process_game_info(session_, game);
         }
-        else {
-            // team2 won
-            if (overtime) {
-                team2.wins_in_overtime += 1;
-                team2.points += 3;
-                team1.loses_in_overtime += 1;
-                team1.points += 2;
-            }
-            else {
-                team2.wins += 1;
-                team2.points += 5;
-                team1.loses += 1;
-                team1.points += 1;
-            }
+        catch (...) {
+            // Game may be half applied, even if it is the first one after
+            // checkpoint, so drop everything after the checkpoint right away
+            session_.discard_changes();
+            games_in_batch_ = 0;
+            throw;
         }
+        games_in_batch_++;
 
-        storage.update(team1);
-        storage.update(team2);
-
-        std::cout << "\tTeam data updated!" << std::endl;
-
-        auto process_players = [&storage,
-                                match_lenght,
-                                &get_or_create_team_players](
-                                   const auto &our_team,
-                                   const auto &en_team,
-                                   int team_id) {
-            // [numb -> MPlayer]
-            auto players =
-                get_or_create_team_players(team_id, our_team.players);
-
-            {  // yellow and red cards
-                std::set<int> yellow_cards;
-                for (const auto &pen : our_team.penalties) {
-                    if (yellow_cards.count(pen.number) != 0) {
-                        players[pen.number].red_cards += 1;
-                        players[pen.number].yellow_cards -= 1;
-                    }
-                    else {
-                        players[pen.number].yellow_cards += 1;
-                        yellow_cards.insert(pen.number);
-                    }
-                }
-            }
-            {  // goals and assists
-                for (const auto &goal : our_team.goals) {
-                    if (goal.from_game) {
-                        players[goal.number].goals += 1;
-                    }
-                    else {
-                        players[goal.number].goal_from_penalty += 1;
-                    }
-
-                    for (int a : goal.assists) {
-                        players[a].assists += 1;
-                    }
-                }
-            }
-
-            {  // games player and minutes on the field (and
-               // goalkeper_got_scores)
-                for (const auto &p : players) {
-                    const int my_numb = p.first;
-
-                    int play_time = 0;
-
-                    int last_event_time = 0;  // when last even happened
-                    bool is_playing = false;
-
-                    if (std::find(our_team.starting_players.begin(),
-                                  our_team.starting_players.end(),
-                                  my_numb) != our_team.starting_players.end()) {
-                        is_playing = true;
-                    }
-
-                    // All goals the goalkeeper got, when they were at field.
-                    // not left half-open interval (L; R]
-                    auto goalkeeper_got_goals = [&en_team, &players, my_numb](
-                                                    int L, int R) {
-                        for (const auto &goal : en_team.goals) {
-                            if (L < goal.time and goal.time <= R) {
-                                players[my_numb].goalkeper_got_scores += 1;
-                            }
-                        }
-                    };
-
-                    for (const auto &sub_event : our_team.subsitutions) {
-                        if (sub_event.p_out == my_numb) {
-                            assert(is_playing);
-                            play_time += (sub_event.time - last_event_time);
-
-                            // if we are goalkeeper last count how many goals we
-                            // got in this time frame
-                            if (p.second.p_type ==
-                                XMLParser::Data::PlayerType::GOALKEEPER) {
-                                goalkeeper_got_goals(last_event_time,
-                                                     sub_event.time);
-                            }
-
-                            is_playing = false;
-                            last_event_time = sub_event.time;
-                        }
-                        else if (sub_event.p_in == my_numb) {
-                            assert(is_playing == false);
-                            is_playing = true;
-
-                            last_event_time = sub_event.time;
-                        }
-                    }
-
-                    if (is_playing) {
-                        // player played till the end
-                        play_time += (match_lenght - last_event_time);
-
-                        // if we are goalkeeper last count how many goals we got
-                        // in this time frame
-                        if (p.second.p_type ==
-                            XMLParser::Data::PlayerType::GOALKEEPER) {
-                            goalkeeper_got_goals(last_event_time, match_lenght);
-                        }
-                    }
-
-                    // Player played the game, iff they were at least one second
-                    // in the game
-                    if (play_time > 0) {
-                        players[my_numb].games += 1;
-                        players[my_numb].seconds_on_field += play_time;
-                    }
-                }
-            }
+        if (games_per_commit_ != 0 and games_in_batch_ >= games_per_commit_) {
+            commit();
+        }
+    }
 
-            // commit all changes
-            storage.transaction([&] {
-                for (auto x : players) {
-                    storage.update(x.second);
-                }
+    void IngestBatch::commit()
+    {
+        if (games_in_batch_ == 0)
+            return;
 
-                return true;
-            });
-        };
+        session_.flush();
+        std::cout << "Committed " << games_in_batch_ << " game(s)"
+                  << std::endl;
+        games_in_batch_ = 0;
+    }
 
-        process_players(team1_data, team2_data, team1.id);
-        std::cout << "\tFirst team players updated!" << std::endl;
-        process_players(team2_data, team1_data, team2.id);
-        std::cout << "\tSecond team players updated!" << std::endl;
+    void process_game_info(Session &session,
+                           const LFL::XMLParser::Data::Game &game)
+    {
+        session.league().apply(game);
     }
 
     static std::string generate_header()
@@ -497,225 +334,469 @@ namespace LFL::Database {
 )""";
     }
 
-    void generate_html_output(const std::string &filename,
-                              size_t truncate_after)
+    /// Read-only data, all report sections are rendered from.
+    struct ReportSnapshot {
+        std::vector<MTeam> teams;
+        std::map<int, std::string> team_names;
+        /// Row limit of players tables, already clamped to players count
+        size_t truncate_after;
+
+        /// Top truncate_after players of each ranking, already ordered
+        std::vector<MPlayer> best_strikers;
+        std::vector<MPlayer> mvps;
+        std::vector<MPlayer> goalkeepers;
+        std::vector<MPlayer> hardworking;
+
+        std::vector<const MTeam *> team_order() const
+        {
+            std::vector<const MTeam *> res;
+            res.reserve(teams.size());
+            for (const auto &t : teams) {
+                res.push_back(&t);
+            }
+            return res;
+        }
+        /// Teams sorted by (score, gd), ties are broken by id. Popular
+        /// clubs table is stably sorted from this order, so its ties keep
+        /// it.
+        std::vector<const MTeam *> club_order() const
+        {
+            auto res = team_order();
+            std::sort(res.begin(),
+                      res.end(),
+                      [](const MTeam *a, const MTeam *b) {
+                if (a->points != b->points)
+                    return a->points > b->points;
+                if (a->gd() != b->gd())
+                    return a->gd() > b->gd();
+                return a->id < b->id;
+            });
+            return res;
+        }
+    };
+
+    std::vector<MPlayer> rank_players(Storage &storage,
+                                      PlayerRanking ranking,
+                                      size_t limit)
     {
-        double start_time = clock();
+        using namespace sqlite_orm;
+        const int rows = static_cast<int>(limit);
+        // Ordered and limited by SQLite, using PlayerRank expressions and
+        // their indices. Ties are broken by id.
+        switch (ranking) {
+        case PlayerRanking::BEST_STRIKER:
+            // Sort by (points, goals, p/game)
+            return storage.get_all<MPlayer>(
+                multi_order_by(order_by(PlayerRank::points()).desc(),
+                               order_by(PlayerRank::sum_goals()).desc(),
+                               order_by(PlayerRank::point_per_h()).desc(),
+                               order_by(&MPlayer::id)),
+                sqlite_orm::limit(rows));
+        case PlayerRanking::MVP:
+            // Sort by (p/h, time on field)
+            return storage.get_all<MPlayer>(
+                multi_order_by(order_by(PlayerRank::point_per_h()).desc(),
+                               order_by(&MPlayer::seconds_on_field).desc(),
+                               order_by(&MPlayer::id)),
+                sqlite_orm::limit(rows));
+        case PlayerRanking::GOALKEEPER:
+            // Sort by (goals against/h, time on field)
+            return storage.get_all<MPlayer>(
+                where(c(&MPlayer::p_type) ==
+                      static_cast<int>(XMLParser::Data::PlayerType::GOALKEEPER)),
+                multi_order_by(order_by(PlayerRank::gaa_per_h()),
+                               order_by(&MPlayer::seconds_on_field).desc(),
+                               order_by(&MPlayer::id)),
+                sqlite_orm::limit(rows));
+        case PlayerRanking::HARDWORKING:
+            // Sort by (seconds)
+            return storage.get_all<MPlayer>(
+                multi_order_by(order_by(&MPlayer::seconds_on_field).desc(),
+                               order_by(&MPlayer::id)),
+                sqlite_orm::limit(rows));
+        }
+        return {};
+    }
 
-        auto storage = create_database_connection();
+    static void load_best_strikers(Storage &storage, ReportSnapshot &snapshot)
+    {
+        snapshot.best_strikers = rank_players(
+            storage, PlayerRanking::BEST_STRIKER, snapshot.truncate_after);
+    }
 
-        auto teams = storage.get_all<MTeam>();
-        auto players = storage.get_all<MPlayer>();
+    static void load_mvps(Storage &storage, ReportSnapshot &snapshot)
+    {
+        snapshot.mvps =
+            rank_players(storage, PlayerRanking::MVP, snapshot.truncate_after);
+    }
 
-        std::cout << "Processing " << teams.size() << " teams!" << std::endl;
-        std::cout << "And " << players.size() << " players!" << std::endl;
+    static void load_goalkeepers(Storage &storage, ReportSnapshot &snapshot)
+    {
+        snapshot.goalkeepers = rank_players(
+            storage, PlayerRanking::GOALKEEPER, snapshot.truncate_after);
+    }
 
-        if (truncate_after == 0u or truncate_after >= players.size()) {
-            truncate_after = static_cast<int>(players.size());
-            std::cout << "Creating full tables with " << truncate_after
-                      << " rows!" << std::endl;
-        }
-        else {
-            std::cout << "Truncating tables after " << truncate_after
-                      << " rows!" << std::endl;
+    static void load_hardworking(Storage &storage, ReportSnapshot &snapshot)
+    {
+        snapshot.hardworking = rank_players(
+            storage, PlayerRanking::HARDWORKING, snapshot.truncate_after);
+    }
+
+    static std::string render_club_table(const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(main_table_header());
+
+        auto teams = snapshot.club_order();
+
+        for (size_t i = 0; i < teams.size(); i++) {
+            const auto &t = *teams[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.cell(t.name);
+            out.cell(t.games);
+            out.cell(t.wins);
+            out.cell(t.loses);
+            out.cell(t.wins_in_overtime);
+            out.cell(t.loses_in_overtime);
+            out.cell(t.goals_for);
+            out.cell(t.goals_again);
+            out.cell(t.gd());
+            out.cell(t.points);
+            out.raw("\t</tr>\n");
         }
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-        std::ofstream ofs(filename);
+    static std::string render_best_striker_table(
+        const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(best_striker_header());
+
+        const auto &players = snapshot.best_strikers;
+        for (size_t i = 0; i < players.size(); i++) {
+            const auto &p = players[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.raw("\t\t<td>")
+                .text(p.name)
+                .raw(" ")
+                .text(p.surname)
+                .raw(" (")
+                .number(p.number)
+                .raw(")</td>\n");
+            out.cell(snapshot.team_names.at(p.team_id));
+            out.cell(p.points());
+            out.raw("\t\t<td>")
+                .number(p.sum_goals())
+                .raw("(")
+                .number(p.goal_from_penalty)
+                .raw(")</td>\n");
+            out.cell(p.assists);
+            out.cell(p.games);
+            out.raw("\t</tr>\n");
+        }
 
-        ofs << generate_header();
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-        std::map<int, std::string> team_names;
-        for (const auto c : teams) {
-            team_names[c.id] = c.name;
+    static std::string render_mvp_table(const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(best_scoring_header());
+
+        const auto &players = snapshot.mvps;
+        for (size_t i = 0; i < players.size(); i++) {
+            const auto &p = players[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.raw("\t\t<td>")
+                .text(p.name)
+                .raw(" ")
+                .text(p.surname)
+                .raw(" (")
+                .number(p.number)
+                .raw(")</td>\n");
+            out.cell(snapshot.team_names.at(p.team_id));
+            out.cell(p.point_per_h());
+            out.cell(p.points());
+            out.cell(p.games);
+            out.cell(p.minutes_on_field());
+            out.raw("\t</tr>\n");
         }
 
-        {  // club table
-            ofs << main_table_header();
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-            // Sort by (score, gd)
-            std::sort(teams.begin(), teams.end(), [](MTeam a, MTeam b) {
-                if (a.points != b.points)
-                    return a.points > b.points;
-                if (a.gd() != b.gd())
-                    return a.gd() > b.gd();
-                return false;
-            });
+    static std::string render_goalkeeper_table(const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(best_goalkeeper_header());
+
+        const auto &players = snapshot.goalkeepers;
+        for (size_t i = 0; i < players.size(); i++) {
+            const auto &p = players[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.raw("\t\t<td>")
+                .text(p.name)
+                .raw(" ")
+                .text(p.surname)
+                .raw(" (")
+                .number(p.number)
+                .raw(")</td>\n");
+            out.cell(snapshot.team_names.at(p.team_id));
+            out.cell(p.gaa_per_h());
+            out.cell(p.goalkeper_got_scores);
+            out.cell(p.games);
+            out.cell(p.minutes_on_field());
+            out.raw("\t</tr>\n");
+        }
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-            for (size_t i = 0; i < teams.size(); i++) {
-                const auto &t = teams[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << t.name << "</td>\n";
-                ofs << "\t\t<td>" << t.games << "</td>\n";
-                ofs << "\t\t<td>" << t.wins << "</td>\n";
-                ofs << "\t\t<td>" << t.loses << "</td>\n";
-                ofs << "\t\t<td>" << t.wins_in_overtime << "</td>\n";
-                ofs << "\t\t<td>" << t.loses_in_overtime << "</td>\n";
-                ofs << "\t\t<td>" << t.goals_for << "</td>\n";
-                ofs << "\t\t<td>" << t.goals_again << "</td>\n";
-                ofs << "\t\t<td>" << t.gd() << "</td>\n";
-                ofs << "\t\t<td>" << t.points << "</td>\n";
-                ofs << "\t</tr>\n";
-            }
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
+    static std::string render_hardworking_table(
+        const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(best_hardworking_header());
+
+        const auto &players = snapshot.hardworking;
+        for (size_t i = 0; i < players.size(); i++) {
+            const auto &p = players[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.raw("\t\t<td>")
+                .text(p.name)
+                .raw(" ")
+                .text(p.surname)
+                .raw(" (")
+                .number(p.number)
+                .raw(")</td>\n");
+            out.cell(snapshot.team_names.at(p.team_id));
+            out.cell(p.minutes_on_field());
+            out.raw("\t</tr>\n");
         }
 
-        {  // best striker (points)
-            ofs << best_striker_header();
-            // Sort by (points, goals, p/game)
-            std::sort(players.begin(), players.end(), [](MPlayer a, MPlayer b) {
-                if (a.points() != b.points())
-                    return a.points() > b.points();
-                if (a.sum_goals() != b.sum_goals())
-                    return a.sum_goals() > b.sum_goals();
-                if (a.point_per_h() != b.point_per_h())
-                    return a.point_per_h() > b.point_per_h();
-                return false;
-            });
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-            for (size_t i = 0; i < truncate_after; i++) {
-                const auto &p = players[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << p.name << " " << p.surname << " ("
-                    << p.number << ")</td>\n";
-                ofs << "\t\t<td>" << team_names.at(p.team_id) << "</td>\n";
-                ofs << "\t\t<td>" << p.points() << "</td>\n";
-                ofs << "\t\t<td>" << p.sum_goals() << "(" << p.goal_from_penalty
-                    << ")</td>\n";
-                ofs << "\t\t<td>" << p.assists << "</td>\n";
-                ofs << "\t\t<td>" << p.games << "</td>\n";
-                ofs << "\t</tr>\n";
+    static std::string render_popular_club_table(
+        const ReportSnapshot &snapshot)
+    {
+        HtmlWriter out;
+        out.raw(most_popular_club_header());
+
+        auto teams = snapshot.club_order();
+        // Sort by (avg attendances)
+        std::stable_sort(teams.begin(),
+                  teams.end(),
+                  [](const MTeam *a, const MTeam *b) {
+            if (a->games == b->games) {
+                if (a->sum_of_attendance != b->sum_of_attendance)
+                    return a->points > b->points;
+                return false;
             }
-
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
+            else {
+                return a->sum_of_attendance * 1LL * b->games >
+                       b->sum_of_attendance * 1LL * a->games;
+            }
+        });
+
+        for (size_t i = 0; i < teams.size(); i++) {
+            const auto &t = *teams[i];
+            out.raw("\t<tr>\n");
+            out.raw("\t\t<th scope=\"row\">")
+                .number(static_cast<int>(i + 1))
+                .raw("</th>\n");
+            out.cell(t.name);
+            out.cell(t.avg_attendances());
+            out.raw("\t</tr>\n");
         }
-        {  // MVP (point/h)
-            ofs << best_scoring_header();
-            // Sort by (points, goals, p/game)
-            std::sort(players.begin(), players.end(), [](MPlayer a, MPlayer b) {
-                if (a.point_per_h() != b.point_per_h())
-                    return a.point_per_h() > b.point_per_h();
-                if (a.seconds_on_field != b.seconds_on_field)
-                    return a.seconds_on_field > b.seconds_on_field;
-                return false;
-            });
+        out.raw("</tbody>\n");
+        out.raw("</table>\n");
+        return out.str();
+    }
 
-            for (size_t i = 0; i < truncate_after; i++) {
-                const auto &p = players[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << p.name << " " << p.surname << " ("
-                    << p.number << ")</td>\n";
-                ofs << "\t\t<td>" << team_names.at(p.team_id) << "</td>\n";
-                ofs << "\t\t<td>" << p.point_per_h() << "</td>\n";
-                ofs << "\t\t<td>" << p.points() << "</td>\n";
-                ofs << "\t\t<td>" << p.games << "</td>\n";
-                ofs << "\t\t<td>" << p.minutes_on_field() << "</td>\n";
-                ofs << "\t</tr>\n";
-            }
+    /// Bump when rendering changes, so cached fragments are not reused.
+    /// 2: ranking ties are broken by player id.
+    /// 3: club table ties are broken by team id.
+    static constexpr int REPORT_FORMAT_VERSION = 3;
+
+    struct ReportSection {
+        const char *name;
+        /// Loads players of the section into snapshot, nullptr for teams
+        /// only sections, those do not depend on players table nor row
+        /// limit.
+        void (*load)(Storage &, ReportSnapshot &);
+        std::string (*render)(const ReportSnapshot &);
+
+        bool uses_players() const { return load != nullptr; }
+    };
+
+    /// In order of the page
+    static constexpr ReportSection REPORT_SECTIONS[] = {
+        {"club", nullptr, render_club_table},
+        {"best_striker", load_best_strikers, render_best_striker_table},
+        {"mvp", load_mvps, render_mvp_table},
+        {"goalkeeper", load_goalkeepers, render_goalkeeper_table},
+        {"hardworking", load_hardworking, render_hardworking_table},
+        {"popular_club", nullptr, render_popular_club_table},
+    };
+
+    void generate_html_output(Session &session,
+                              const std::string &filename,
+                              size_t truncate_after)
+    {
+        const auto start_time = std::chrono::steady_clock::now();
 
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
-        }
+        // Report is generated from the database, write pending games first
+        session.flush();
+        auto &storage = session.storage;
 
-        {  // best goalie
-            ofs << best_goalkeeper_header();
-            std::vector<MPlayer> goalies;
-            for (const auto &p : players) {
-                if (p.p_type == XMLParser::Data::PlayerType::GOALKEEPER) {
-                    goalies.push_back(p);
-                }
-            }
+        const size_t teams_count = storage.count<MTeam>();
+        const size_t players_count = storage.count<MPlayer>();
+        std::cout << "Processing " << teams_count << " teams!" << std::endl;
+        std::cout << "And " << players_count << " players!" << std::endl;
 
-            std::sort(goalies.begin(), goalies.end(), [](MPlayer a, MPlayer b) {
-                if (a.gaa_per_h() != b.gaa_per_h())
-                    return a.gaa_per_h() < b.gaa_per_h();
-                if (a.seconds_on_field != b.seconds_on_field)
-                    return a.seconds_on_field > b.seconds_on_field;
-                return false;
-            });
+        if (truncate_after == 0u or truncate_after >= players_count) {
+            truncate_after = players_count;
+            std::cout << "Creating full tables with " << truncate_after
+                      << " rows!" << std::endl;
+        }
+        else {
+            std::cout << "Truncating tables after " << truncate_after
+                      << " rows!" << std::endl;
+        }
 
-            for (size_t i = 0; i < std::min(truncate_after, goalies.size());
-                 i++) {
-                const auto &p = goalies[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << p.name << " " << p.surname << " ("
-                    << p.number << ")</td>\n";
-                ofs << "\t\t<td>" << team_names.at(p.team_id) << "</td>\n";
-                ofs << "\t\t<td>" << p.gaa_per_h() << "</td>\n";
-                ofs << "\t\t<td>" << p.goalkeper_got_scores << "</td>\n";
-                ofs << "\t\t<td>" << p.games << "</td>\n";
-                ofs << "\t\t<td>" << p.minutes_on_field() << "</td>\n";
-                ofs << "\t</tr>\n";
+        const int teams_generation = table_generation(storage, "teams");
+        const int players_generation = table_generation(storage, "players");
+
+        // Sections whose tables did not change since they were rendered last
+        // time are taken from the database, only others are rendered.
+        std::vector<std::string> html(std::size(REPORT_SECTIONS));
+        /// Indices of sections to render, and their new cache rows
+        std::vector<size_t> stale;
+        std::vector<MReportFragment> fragments;
+        for (size_t i = 0; i < std::size(REPORT_SECTIONS); i++) {
+            const auto &section = REPORT_SECTIONS[i];
+
+            MReportFragment key{
+                section.name,
+                REPORT_FORMAT_VERSION,
+                teams_generation,
+                section.uses_players() ? players_generation : 0,
+                section.uses_players() ? static_cast<int>(truncate_after) : 0,
+                "",
+            };
+            auto cached = storage.get_pointer<MReportFragment>(key.section);
+            if (cached and cached->format_version == key.format_version and
+                cached->teams_generation == key.teams_generation and
+                cached->players_generation == key.players_generation and
+                cached->truncate_after == key.truncate_after) {
+                html[i] = std::move(cached->html);
+            }
+            else {
+                stale.push_back(i);
+                fragments.push_back(std::move(key));
             }
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
         }
-
-        {  // Hard working (seconds player)
-            ofs << best_hardworking_header();
-            // Sort by (seconds)
-            std::sort(players.begin(), players.end(), [](MPlayer a, MPlayer b) {
-                if (a.seconds_on_field != b.seconds_on_field)
-                    return a.seconds_on_field > b.seconds_on_field;
-                return false;
-            });
-
-            for (size_t i = 0; i < truncate_after; i++) {
-                const auto &p = players[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << p.name << " " << p.surname << " ("
-                    << p.number << ")</td>\n";
-                ofs << "\t\t<td>" << team_names.at(p.team_id) << "</td>\n";
-                ofs << "\t\t<td>" << p.minutes_on_field() << "</td>\n";
-                ofs << "\t</tr>\n";
+        std::cout << "Reusing " << std::size(REPORT_SECTIONS) - fragments.size()
+                  << " unchanged section(s)" << std::endl;
+
+        Utils::ScopedTimer sort_timer(Utils::Stage::SORT);
+        ReportSnapshot snapshot;
+        snapshot.truncate_after = truncate_after;
+        if (!stale.empty()) {
+            // Teams are needed by every section
+            snapshot.teams = storage.get_all<MTeam>();
+            for (const auto &c : snapshot.teams) {
+                snapshot.team_names[c.id] = c.name;
             }
+        }
+        // Queries share single connection, so they run one by one
+        for (size_t i : stale) {
+            if (REPORT_SECTIONS[i].uses_players())
+                REPORT_SECTIONS[i].load(storage, snapshot);
+        }
+        sort_timer.stop();
+
+        Utils::ScopedTimer render_timer(Utils::Stage::RENDER);
+        // Sections are independent. Players tables have up to
+        // truncate_after rows each, they are rendered by their own threads,
+        // while few rows of teams only tables are rendered by this one.
+        std::vector<std::future<std::string>> rendered(stale.size());
+        for (size_t j = 0; j < stale.size(); j++) {
+            const auto &section = REPORT_SECTIONS[stale[j]];
+            if (section.uses_players()) {
+                rendered[j] = std::async(std::launch::async,
+                                         section.render,
+                                         std::cref(snapshot));
+            }
+        }
+        for (size_t j = 0; j < stale.size(); j++) {
+            const auto &section = REPORT_SECTIONS[stale[j]];
+            if (!section.uses_players())
+                fragments[j].html = section.render(snapshot);
+        }
+        for (size_t j = 0; j < stale.size(); j++) {
+            if (rendered[j].valid())
+                fragments[j].html = rendered[j].get();
+            html[stale[j]] = fragments[j].html;
+        }
 
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
+        if (!fragments.empty()) {
+            auto guard = storage.transaction_guard();
+            storage.replace_range(fragments.begin(), fragments.end());
+            guard.commit();
         }
 
-        {  // Most popular club
-            ofs << most_popular_club_header();
-
-            // Sort by (avg attendances)
-            std::sort(teams.begin(), teams.end(), [](MTeam a, MTeam b) {
-                if (a.games == b.games) {
-                    if (a.sum_of_attendance != b.sum_of_attendance)
-                        return a.points > b.points;
-                    return false;
-                }
-                else {
-                    return a.sum_of_attendance * 1LL * b.games >
-                           b.sum_of_attendance * 1LL * a.games;
-                }
-            });
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(
+            std::fopen(filename.c_str(), "wb"), std::fclose);
+        if (!file)
+            throw std::runtime_error("cannot open file '" + filename + "'");
+        HtmlWriter out(file.get());
 
-            for (size_t i = 0; i < teams.size(); i++) {
-                const auto &t = teams[i];
-                ofs << "\t<tr>\n";
-                ofs << "\t\t<th scope=\"row\">" << (i + 1) << "</th>\n";
-                ofs << "\t\t<td>" << t.name << "</td>\n";
-                ofs << "\t\t<td>" << t.avg_attendances() << "</td>\n";
-                ofs << "\t</tr>\n";
-            }
-            ofs << "</tbody>\n";
-            ofs << "</table>\n";
+        out.raw(generate_header());
+        for (const auto &section : html) {
+            out.raw(section);
         }
 
-        double took_to_generate =
-            (clock() - start_time) / CLOCKS_PER_SEC * 1000;
+        const double took_to_generate = Utils::elapsed_ms(start_time);
         std::cout << "generated in " << took_to_generate << " ms" << std::endl;
-        ofs << "<div>Generation took aprox. " << took_to_generate
-            << " ms.</div>\n";
-        ofs << "<div>LFL 2022 (c)Aleksandrs Zajakins</div>\n";
-
-        ofs << generate_footer();
-        ofs.close();
+        out.raw("<div>Generation took aprox. ")
+            .number(took_to_generate)
+            .raw(" ms.</div>\n");
+        out.raw("<div>LFL 2022 (c)Aleksandrs Zajakins</div>\n");
+
+        out.raw(generate_footer());
+        out.flush();
+
+        // Buffered tail is written by fclose, its error would be lost by
+        // the deleter
+        const bool write_failed = std::ferror(file.get()) != 0;
+        if (std::fclose(file.release()) != 0 or write_failed)
+            throw std::runtime_error("cannot write file '" + filename + "'");
     }
 }  // namespace LFL::Database
@@ -1,11 +1,30 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <sqlite_orm.h>
 
 #include "XMLParser/Parser.h"
 
+namespace sqlite_orm::internal {
+    // sqlite_orm finds the table of an index through its first indexed
+    // column, which has to be a member pointer. Let it look through the
+    // expressions, expression indices of LFL::Database::PlayerRank start
+    // with.
+    template<class L, class R, class... Ds>
+    struct table_type<binary_operator<L, R, Ds...>, void> : table_type<L> {
+    };
+    template<class R, class S, class X, class... Args>
+    struct table_type<built_in_function_t<R, S, X, Args...>, void>
+        : table_type<X> {
+    };
+    template<class T, class E>
+    struct table_type<cast_t<T, E>, void> : table_type<E> {
+    };
+}  // namespace sqlite_orm::internal
+
 namespace LFL::Database {
 
     /// Database model class that represents Player entity
@@ -95,19 +114,268 @@ namespace LFL::Database {
         std::string date;
     };
 
-    /// Creates and loads database scheme, and creates connections
-    /// \returns sqlite_orm database connection
-    auto create_database_connection();
+    /// Database model, change counter of a table. Incremented by every
+    /// flush, that writes rows of the table.
+    struct MTableGeneration {
+        std::string table;
+        int generation;
+    };
+
+    /// Database model, rendered report section with generations of tables
+    /// it was rendered from
+    struct MReportFragment {
+        std::string section;
+        int format_version;
+        int teams_generation;
+        int players_generation;
+        /// Row limit of players tables, 0 for teams only sections
+        int truncate_after;
+        std::string html;
+    };
+
+    /// Database model, protocol file recorded in the database, so it is not
+    /// processed again while unchanged. See FileManifest.
+    struct MIngestedFile {
+        /// Absolute, normalized path
+        std::string path;
+        long long size;
+        /// Last write time, in ticks of std::filesystem clock
+        long long mtime;
+        /// Utils::hash64 of file contents, stored as signed
+        long long hash;
+    };
+
+    /// SQL expressions of MPlayer ranking values, for ORDER BY of report
+    /// rankings and for the expression indices matching them. They are
+    /// computed from stored columns, so no writer can leave them stale.
+    namespace PlayerRank {
+        /// MPlayer::points()
+        inline auto points()
+        {
+            using namespace sqlite_orm;
+            return c(&MPlayer::goals) + c(&MPlayer::assists) +
+                   c(&MPlayer::goal_from_penalty);
+        }
+        /// MPlayer::sum_goals()
+        inline auto sum_goals()
+        {
+            using namespace sqlite_orm;
+            return c(&MPlayer::goals) + c(&MPlayer::goal_from_penalty);
+        }
+        /// Orders as MPlayer::point_per_h(). Constants would be bound as
+        /// parameters, and the query would not match its index, so the
+        /// value is per second, and division by zero (NULL) is replaced by
+        /// seconds_on_field, that is 0 exactly then.
+        inline auto point_per_h()
+        {
+            using namespace sqlite_orm;
+            return ifnull<double>(
+                cast<double>(points()) / c(&MPlayer::seconds_on_field),
+                &MPlayer::seconds_on_field);
+        }
+        /// Orders as MPlayer::gaa_per_h(), see point_per_h()
+        inline auto gaa_per_h()
+        {
+            using namespace sqlite_orm;
+            return ifnull<double>(cast<double>(&MPlayer::goalkeper_got_scores) /
+                                      c(&MPlayer::seconds_on_field),
+                                  &MPlayer::seconds_on_field);
+        }
+    }  // namespace PlayerRank
+
+    /// Describes database scheme
+    /// \returns sqlite_orm storage, not yet synced nor opened
+    /// \see Session
+    inline auto make_database_storage(const std::string &filename)
+    {
+        using namespace sqlite_orm;
+        return make_storage(
+            filename,
+            // Lookup keys used for every processed game. Indices are listed
+            // before tables, as sqlite_orm syncs storage from the last
+            // element, so tables exist by the time indices are created.
+            make_unique_index("idx_teams_name", &MTeam::name),
+            make_unique_index(
+                "idx_players_team_number", &MPlayer::team_id, &MPlayer::number),
+            make_unique_index("idx_history_team_date",
+                              &MMatchHistory::team_id,
+                              &MMatchHistory::date),
+            // Report rankings, see generate_html_output(). Ties are broken
+            // by id, that is the order of equal index entries.
+            make_index("idx_players_striker",
+                       indexed_column(PlayerRank::points()).desc(),
+                       indexed_column(PlayerRank::sum_goals()).desc(),
+                       indexed_column(PlayerRank::point_per_h()).desc()),
+            make_index("idx_players_mvp",
+                       indexed_column(PlayerRank::point_per_h()).desc(),
+                       indexed_column(&MPlayer::seconds_on_field).desc()),
+            make_index("idx_players_goalkeeper",
+                       &MPlayer::p_type,
+                       indexed_column(PlayerRank::gaa_per_h()),
+                       indexed_column(&MPlayer::seconds_on_field).desc()),
+            make_index("idx_players_hardworking",
+                       indexed_column(&MPlayer::seconds_on_field).desc()),
+            make_table(
+                "teams",
+                make_column("id", &MTeam::id, primary_key()),
+                make_column("name", &MTeam::name),
+                make_column("games", &MTeam::games),
+                make_column("wins", &MTeam::wins),
+                make_column("loses", &MTeam::loses),
+                make_column("wins_in_overtime", &MTeam::wins_in_overtime),
+                make_column("loses_in_overtime", &MTeam::loses_in_overtime),
+                make_column("points", &MTeam::points),
+                make_column("goals_for", &MTeam::goals_for),
+                make_column("goals_again", &MTeam::goals_again),
+                make_column("sum_of_attendance", &MTeam::sum_of_attendance)),
+            make_table(
+                "players",
+                make_column("id", &MPlayer::id, primary_key()),
+                make_column("number", &MPlayer::number),
+                make_column("name", &MPlayer::name),
+                make_column("surname", &MPlayer::surname),
+                make_column("team_id", &MPlayer::team_id),
+                make_column("p_type", &MPlayer::p_type),
+                make_column("games", &MPlayer::games),
+                make_column("seconds_on_field", &MPlayer::seconds_on_field),
+                make_column("yellow_cards", &MPlayer::yellow_cards),
+                make_column("red_cards", &MPlayer::red_cards),
+                make_column("goals", &MPlayer::goals),
+                make_column("assists", &MPlayer::assists),
+                make_column("goal_from_penalty", &MPlayer::goal_from_penalty),
+                make_column("goalkeper_got_scores",
+                            &MPlayer::goalkeper_got_scores)),
+            make_table("history",
+                       make_column("id", &MMatchHistory::id, primary_key()),
+                       make_column("team_id", &MMatchHistory::team_id),
+                       make_column("date", &MMatchHistory::date)),
+            make_table("generations",
+                       make_column("table_name",
+                                   &MTableGeneration::table,
+                                   primary_key()),
+                       make_column("generation", &MTableGeneration::generation)),
+            make_table(
+                "report_fragments",
+                make_column("section", &MReportFragment::section, primary_key()),
+                make_column("format_version", &MReportFragment::format_version),
+                make_column("teams_generation",
+                            &MReportFragment::teams_generation),
+                make_column("players_generation",
+                            &MReportFragment::players_generation),
+                make_column("truncate_after", &MReportFragment::truncate_after),
+                make_column("html", &MReportFragment::html)),
+            make_table("ingested_files",
+                       make_column("path", &MIngestedFile::path, primary_key()),
+                       make_column("size", &MIngestedFile::size),
+                       make_column("mtime", &MIngestedFile::mtime),
+                       make_column("hash", &MIngestedFile::hash)));
+    }
+
+    /// sqlite_orm storage type of LFL database
+    using Storage = decltype(make_database_storage(""));
+
+    class LeagueState;
+    class FileManifest;
+
+    /// \returns change counter of the table, 0 if it was never written
+    int table_generation(Storage &storage, const std::string &table);
+    /// Increments change counter of the table
+    void bump_table_generation(Storage &storage, const std::string &table);
+
+    /// Long living database connection. Scheme is synced once at creation,
+    /// and connection stays open until session is destroyed, so it is
+    /// expected to be created once per process and passed around.
+    /// Processed games are aggregated in memory (see LeagueState) and
+    /// written to the database only by flush().
+    class Session {
+    public:
+        /// \param filename path to sqlite database, ":memory:" for in memory
+        /// database.
+        explicit Session(const std::string &filename = "lfl.sqlite");
+        ~Session();
+
+        // sqlite_orm storage copy opens new connection, forbid it
+        Session(const Session &) = delete;
+        Session &operator=(const Session &) = delete;
+
+        /// \returns in memory league state, loaded from the database on
+        /// first use.
+        LeagueState &league();
+        /// \returns already ingested files, loaded from the database on
+        /// first use.
+        FileManifest &manifest();
+        /// Writes all changes of the league state and the manifest in one
+        /// transaction.
+        void flush();
+        /// Drops league and manifest changes since the last flush.
+        void discard_changes();
+
+        Storage storage;
+
+    private:
+        std::unique_ptr<LeagueState> league_;
+        std::unique_ptr<FileManifest> manifest_;
+    };
+
+    /// Groups ingest of many games into few SQLite transactions.
+    /// Changes are flushed every games_per_commit games (checkpoint) or
+    /// by commit(). If batch is destroyed before commit (e.g. exception was
+    /// thrown) or game can not be recorded, games after last checkpoint are
+    /// discarded, so database is never left with partially recorded game.
+    class IngestBatch {
+    public:
+        /// \param games_per_commit commit after this many games, 0 if only
+        /// at commit().
+        IngestBatch(Session &session, size_t games_per_commit);
+        ~IngestBatch();
+
+        IngestBatch(const IngestBatch &) = delete;
+        IngestBatch &operator=(const IngestBatch &) = delete;
+
+        /// Records game in the session
+        /// \see process_game_info
+        void add(const LFL::XMLParser::Data::Game &game);
+        /// Records game and the file it was parsed from, file is committed
+        /// together with the game.
+        /// \see FileManifest
+        void add(const LFL::XMLParser::Data::Game &game,
+                 const MIngestedFile &source);
+        /// Commits all added games, no-op if there is nothing to commit.
+        void commit();
+
+    private:
+        /// Records game and source file (if any). If it throws, changes
+        /// since the last checkpoint are discarded.
+        void record(const LFL::XMLParser::Data::Game &game,
+                    const MIngestedFile *source);
+
+        Session &session_;
+        const size_t games_per_commit_;
+        size_t games_in_batch_ = 0;
+    };
 
-    /// Processes and records this game info
+    /// Processes and records this game info into session league state.
+    /// Changes reach the database on Session::flush(), use IngestBatch to
+    /// flush them periodically.
+    /// \param session Opened database session.
     /// \param Parse from XML file game data.
     /// \see LFL::XMLParser::Data::Game
-    void process_game_info(const LFL::XMLParser::Data::Game &game);
-    /// Generates html report
+    void process_game_info(Session &session,
+                           const LFL::XMLParser::Data::Game &game);
+    /// Player rankings of the report
+    enum class PlayerRanking { BEST_STRIKER, MVP, GOALKEEPER, HARDWORKING };
+    /// \returns top players of the ranking, ties are broken by id
+    /// \param limit maximal count of returned players
+    std::vector<MPlayer> rank_players(Storage &storage,
+                                      PlayerRanking ranking,
+                                      size_t limit);
+    /// Generates html report, flushes session changes first.
+    /// \param session Opened database session.
     /// \param filename path to the generated html file
     /// \param truncate_after maximal row limit in players tables, 0 if
     /// infinite.
-    void generate_html_output(const std::string &filename,
+    void generate_html_output(Session &session,
+                              const std::string &filename,
                               size_t truncate_after);
 
 }  // namespace LFL::Database
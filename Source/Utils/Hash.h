@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace LFL::Utils {
+
+    /// XXH64 hash of the bytes, fast non cryptographic hash, used to detect
+    /// changed files.
+    uint64_t hash64(const void *data, size_t size, uint64_t seed = 0);
+}  // namespace LFL::Utils
@@ -0,0 +1,148 @@
+#include "Timing.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace LFL::Utils {
+
+    /// File processed by this thread, nullptr if none
+    static thread_local const std::string *current_file = nullptr;
+
+    /// Histogram bucket upper bounds are powers of two microseconds
+    static const size_t HISTOGRAM_BUCKETS = 32;
+
+    const char *stage_name(Stage stage)
+    {
+        switch (stage) {
+        case Stage::READ: return "read";
+        case Stage::PARSE: return "parse";
+        case Stage::TEAM_LOOKUP: return "team_lookup";
+        case Stage::HISTORY_CHECK: return "history_check";
+        case Stage::PLAYER_LOAD: return "player_load";
+        case Stage::STATS: return "stats";
+        case Stage::COMMIT: return "commit";
+        case Stage::SORT: return "sort";
+        case Stage::RENDER: return "render";
+        case Stage::COUNT: break;
+        }
+        return "unknown";
+    }
+
+    static void write_json_string(std::ostream &os, const std::string &str)
+    {
+        os << '"';
+        for (char c : str) {
+            if (c == '"' or c == '\\')
+                os << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                os << ' ';
+            else
+                os << c;
+        }
+        os << '"';
+    }
+
+    Timings &Timings::instance()
+    {
+        static Timings timings;
+        return timings;
+    }
+
+    void Timings::record(Stage stage, double ms)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        samples_[size_t(stage)].push_back(ms);
+        if (current_file != nullptr) {
+            auto &times = files_[*current_file];
+            times[size_t(stage)] += ms;
+        }
+    }
+
+    void Timings::write_json(std::ostream &os) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        os << "{\n";
+        os << "  \"stages\": {\n";
+        for (size_t s = 0; s < size_t(Stage::COUNT); s++) {
+            const auto &samples = samples_[s];
+
+            double total = 0;
+            size_t buckets[HISTOGRAM_BUCKETS] = {};
+            size_t used_buckets = 0;
+            for (double ms : samples) {
+                total += ms;
+                // Smallest power of two microseconds, that is not below
+                const double us = std::max(ms * 1000, 1.0);
+                const size_t b = std::min(
+                    static_cast<size_t>(std::ceil(std::log2(us))),
+                    HISTOGRAM_BUCKETS - 1);
+                buckets[b]++;
+                used_buckets = std::max(used_buckets, b + 1);
+            }
+
+            os << "    \"" << stage_name(Stage(s))
+               << "\": {\"count\": " << samples.size()
+               << ", \"total_ms\": " << total;
+            if (!samples.empty()) {
+                auto [min, max] =
+                    std::minmax_element(samples.begin(), samples.end());
+                os << ", \"min_ms\": " << *min << ", \"max_ms\": " << *max;
+            }
+            os << ", \"histogram_us\": [";
+            for (size_t b = 0; b < used_buckets; b++) {
+                os << (b != 0 ? ", " : "") << "{\"le\": " << (1ull << b)
+                   << ", \"count\": " << buckets[b] << "}";
+            }
+            os << "]}" << (s + 1 < size_t(Stage::COUNT) ? "," : "") << "\n";
+        }
+        os << "  },\n";
+
+        os << "  \"files\": [\n";
+        for (auto it = files_.begin(); it != files_.end(); ++it) {
+            os << "    {\"file\": ";
+            write_json_string(os, it->first);
+            for (size_t s = 0; s < size_t(Stage::COUNT); s++) {
+                if (it->second[s] != 0)
+                    os << ", \"" << stage_name(Stage(s))
+                       << "_ms\": " << it->second[s];
+            }
+            os << "}" << (std::next(it) != files_.end() ? "," : "") << "\n";
+        }
+        os << "  ]\n";
+        os << "}\n";
+    }
+
+    FileScope::FileScope(const std::string &file)
+        : previous_(current_file)
+    {
+        current_file = &file;
+    }
+
+    FileScope::~FileScope() { current_file = previous_; }
+
+    ScopedTimer::ScopedTimer(Stage stage)
+        : stage_(stage)
+        , enabled_(Timings::instance().enabled())
+    {
+        if (enabled_)
+            start_ = std::chrono::steady_clock::now();
+    }
+
+    ScopedTimer::~ScopedTimer() { stop(); }
+
+    void ScopedTimer::stop()
+    {
+        if (enabled_)
+            Timings::instance().record(stage_, elapsed_ms(start_));
+        enabled_ = false;
+    }
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+            .count();
+    }
+}  // namespace LFL::Utils
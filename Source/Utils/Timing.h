@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace LFL::Utils {
+
+    /// Measured stages of ingest and report generation
+    enum class Stage {
+        READ,
+        PARSE,
+        TEAM_LOOKUP,
+        HISTORY_CHECK,
+        PLAYER_LOAD,
+        STATS,
+        COMMIT,
+        SORT,
+        RENDER,
+        COUNT
+    };
+
+    const char *stage_name(Stage stage);
+
+    /// Collects wall clock durations of stages, per file and in total.
+    /// Collection is off by default, then timers cost one atomic load.
+    /// Thread safe.
+    class Timings {
+    public:
+        static Timings &instance();
+
+        void enable() { enabled_ = true; }
+        bool enabled() const { return enabled_; }
+
+        /// Records duration of stage, for file processed by the calling
+        /// thread (see FileScope) if any.
+        void record(Stage stage, double ms);
+
+        /// Writes JSON report: per stage totals with histogram of
+        /// durations, and per file totals of every stage.
+        void write_json(std::ostream &os) const;
+
+    private:
+        using StageTimes = std::array<double, size_t(Stage::COUNT)>;
+
+        std::atomic<bool> enabled_{false};
+        mutable std::mutex mutex_;
+        /// Every recorded duration, in ms
+        std::array<std::vector<double>, size_t(Stage::COUNT)> samples_;
+        std::map<std::string, StageTimes> files_;
+    };
+
+    /// Stages measured by the calling thread, while object lives, are
+    /// attributed to the file
+    class FileScope {
+    public:
+        explicit FileScope(const std::string &file);
+        ~FileScope();
+        FileScope(const FileScope &) = delete;
+        FileScope &operator=(const FileScope &) = delete;
+
+    private:
+        const std::string *previous_;
+    };
+
+    /// Records its lifetime as duration of the stage
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Stage stage);
+        ~ScopedTimer();
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+        /// Records duration now, instead of at destruction
+        void stop();
+
+    private:
+        Stage stage_;
+        bool enabled_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    /// \returns wall time since \p start in ms
+    double elapsed_ms(std::chrono::steady_clock::time_point start);
+}  // namespace LFL::Utils
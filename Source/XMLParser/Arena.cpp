@@ -0,0 +1,90 @@
+#include "Arena.h"
+
+#include <cstring>
+
+namespace LFL::XMLParser {
+
+    std::string_view StringTable::intern(std::string_view str)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return intern_locked(str);
+    }
+
+    void StringTable::intern(std::string_view *strs, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < count; i++) {
+            strs[i] = intern_locked(strs[i]);
+        }
+    }
+
+    std::string_view StringTable::intern_locked(std::string_view str)
+    {
+        auto it = strings_.find(str);
+        if (it != strings_.end())
+            return *it;
+
+        char *copy = static_cast<char *>(chars_.allocate(str.size() + 1, 1));
+        std::memcpy(copy, str.data(), str.size());
+        copy[str.size()] = '\0';
+
+        return *strings_.emplace(copy, str.size()).first;
+    }
+
+    size_t StringTable::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return strings_.size();
+    }
+
+    StringTable &shared_string_table()
+    {
+        static StringTable table;
+        return table;
+    }
+
+    void *GameArena::OverflowCounter::do_allocate(size_t bytes,
+                                                  size_t alignment)
+    {
+        allocated += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void GameArena::OverflowCounter::do_deallocate(void *p,
+                                                   size_t bytes,
+                                                   size_t alignment)
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool GameArena::OverflowCounter::do_is_equal(
+        const std::pmr::memory_resource &other) const noexcept
+    {
+        return this == &other;
+    }
+
+    GameArena::GameArena(size_t initial_size, StringTable &strings)
+        : strings_(strings)
+        , buffer_(initial_size)
+    {
+        resource_.emplace(buffer_.data(), buffer_.size(), &overflow_);
+    }
+
+    GameMemory GameArena::memory()
+    {
+        return GameMemory{&*resource_, &strings_};
+    }
+
+    void GameArena::reset()
+    {
+        resource_.reset();  // releases overflow chunks
+
+        if (overflow_.allocated != 0) {
+            // Last game did not fit, next time allocate everything at once
+            buffer_.resize(buffer_.size() + overflow_.allocated);
+            overflow_.allocated = 0;
+        }
+
+        resource_.emplace(buffer_.data(), buffer_.size(), &overflow_);
+    }
+}  // namespace LFL::XMLParser
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace LFL::XMLParser {
+
+    /// Set of unique strings. Interned string is stored once and stays valid
+    /// (and at the same address) until the table is destroyed, so parsed data
+    /// keeps only std::string_view to it. Safe to use from multiple threads.
+    class StringTable {
+    public:
+        StringTable() = default;
+        StringTable(const StringTable &) = delete;
+        StringTable &operator=(const StringTable &) = delete;
+
+        /// \returns view to the table owned copy of str
+        std::string_view intern(std::string_view str);
+        /// Interns count strings at once, taking the lock only once. Every
+        /// view is replaced by the view to the table owned copy.
+        void intern(std::string_view *strs, size_t count);
+        /// \returns count of unique strings in the table
+        size_t size() const;
+
+    private:
+        std::string_view intern_locked(std::string_view str);
+
+        mutable std::mutex mutex_;
+        /// Characters of all interned strings
+        std::pmr::monotonic_buffer_resource chars_;
+        std::unordered_set<std::string_view> strings_;
+    };
+
+    /// Process wide table, used for player and team names by default, so
+    /// names repeated in every protocol of the season are stored only once.
+    StringTable &shared_string_table();
+
+    /// Where parsed game is allocated: all containers of LFL::Data objects go
+    /// to resource, all strings are interned into strings.
+    struct GameMemory {
+        std::pmr::memory_resource *resource = std::pmr::new_delete_resource();
+        StringTable *strings = &shared_string_table();
+    };
+
+    /// Monotonic memory for one parsed game at a time. Whole game is
+    /// allocated from single buffer, which is kept between games and grows to
+    /// the biggest game seen, so in steady state parsing game does not
+    /// allocate at all. Not thread-safe, use one arena per thread.
+    class GameArena {
+    public:
+        explicit GameArena(size_t initial_size = 16 * 1024,
+                           StringTable &strings = shared_string_table());
+        GameArena(const GameArena &) = delete;
+        GameArena &operator=(const GameArena &) = delete;
+
+        /// Memory to pass to the parser.
+        /// \see LFL::XMLParser::parse_game_file
+        GameMemory memory();
+
+        /// Frees everything allocated from the arena, all games parsed
+        /// into it become invalid. Interned strings are not affected.
+        void reset();
+
+        /// \returns bytes of the reusable buffer
+        size_t capacity() const { return buffer_.size(); }
+
+    private:
+        /// Upstream of the monotonic resource, counts bytes that did not fit
+        /// into the buffer.
+        class OverflowCounter : public std::pmr::memory_resource {
+        public:
+            size_t allocated = 0;
+
+        private:
+            void *do_allocate(size_t bytes, size_t alignment) override;
+            void do_deallocate(void *p,
+                               size_t bytes,
+                               size_t alignment) override;
+            bool do_is_equal(
+                const std::pmr::memory_resource &other) const noexcept override;
+        };
+
+        StringTable &strings_;
+        std::vector<std::byte> buffer_;
+        OverflowCounter overflow_;
+        std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    };
+}  // namespace LFL::XMLParser
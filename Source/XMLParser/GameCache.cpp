@@ -0,0 +1,512 @@
+#include "GameCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+#include "Utils/Hash.h"
+
+namespace LFL::XMLParser {
+
+    static constexpr char MAGIC[4] = {'L', 'F', 'L', 'G'};
+
+    /// Sections of the cache file, in file order
+    enum SectionId {
+        STRINGS,
+        CHARS,
+        REFEREES,
+        TEAMS,
+        PLAYERS,
+        SUBSTITUTIONS,
+        STARTING_PLAYERS,
+        PENALTIES,
+        GOALS,
+        ASSISTS,
+        SECTION_COUNT
+    };
+
+    /// Byte offset of the first record and count of records
+    struct Section {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    /// Records of some section, that belong to one team or goal
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        /// CacheSource of the protocol
+        int64_t source_size;
+        int64_t source_mtime;
+        uint64_t source_hash;
+        /// Utils::hash64 of everything after the header
+        uint64_t contents_hash;
+        uint32_t file_size;
+        /// Strings are indexes to the string table
+        uint32_t date;
+        uint32_t place;
+        int32_t attendance;
+        Section sections[SECTION_COUNT];
+    };
+    static_assert(sizeof(Header) == 136);
+
+    /// Date and place are the first strings of the table. They are copied
+    /// to the game, only names after them are interned.
+    static constexpr uint32_t GAME_TEXTS = 2;
+
+    /// Characters of string in CHARS section
+    struct StringRecord {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct RefereeRecord {
+        uint32_t name;
+        uint32_t surname;
+        uint32_t main;
+    };
+
+    struct TeamRecord {
+        uint32_t name;
+        Range players;
+        Range substitutions;
+        Range starting_players;
+        Range penalties;
+        Range goals;
+    };
+
+    struct PlayerRecord {
+        uint32_t name;
+        uint32_t surname;
+        int32_t p_type;
+        int32_t number;
+    };
+
+    struct SubstitutionRecord {
+        int32_t time;
+        int32_t p_out;
+        int32_t p_in;
+    };
+
+    struct PenaltyRecord {
+        int32_t time;
+        int32_t number;
+    };
+
+    struct GoalRecord {
+        int32_t time;
+        int32_t number;
+        uint32_t from_game;
+        Range assists;
+    };
+
+    /// Bytes of one record of every section, starting players and assists
+    /// are plain numbers
+    static constexpr size_t RECORD_SIZES[SECTION_COUNT] = {
+        sizeof(StringRecord),  1,
+        sizeof(RefereeRecord), sizeof(TeamRecord),
+        sizeof(PlayerRecord),  sizeof(SubstitutionRecord),
+        sizeof(int32_t),       sizeof(PenaltyRecord),
+        sizeof(GoalRecord),    sizeof(int32_t),
+    };
+
+    [[noreturn]] static void corrupted()
+    {
+        throw ParseError("Corrupted game cache");
+    }
+
+    /// Records of the game, before they are laid out to the file
+    struct Tables {
+        std::unordered_map<std::string_view, uint32_t> string_ids;
+        std::vector<StringRecord> strings;
+        std::string chars;
+        std::vector<RefereeRecord> referees;
+        std::vector<TeamRecord> teams;
+        std::vector<PlayerRecord> players;
+        std::vector<SubstitutionRecord> substitutions;
+        std::vector<int32_t> starting_players;
+        std::vector<PenaltyRecord> penalties;
+        std::vector<GoalRecord> goals;
+        std::vector<int32_t> assists;
+
+        /// \returns index of str in the string table, added if it is new
+        uint32_t string(std::string_view str)
+        {
+            auto [it, inserted] =
+                string_ids.emplace(str, uint32_t(strings.size()));
+            if (inserted) {
+                strings.push_back(
+                    {uint32_t(chars.size()), uint32_t(str.size())});
+                chars += str;
+            }
+            return it->second;
+        }
+
+        /// \returns index of str in the string table, always added, so
+        /// names never refer to it
+        uint32_t text(std::string_view str)
+        {
+            strings.push_back({uint32_t(chars.size()), uint32_t(str.size())});
+            chars += str;
+            return uint32_t(strings.size() - 1);
+        }
+    };
+
+    /// Appends range of records to vector
+    template<typename T, typename Source, typename Convert>
+    static Range append(std::vector<T> &records,
+                        const Source &source,
+                        Convert convert)
+    {
+        const Range range = {uint32_t(records.size()),
+                             uint32_t(source.size())};
+        for (const auto &item : source) {
+            records.push_back(convert(item));
+        }
+        return range;
+    }
+
+    /// Appends section to the file contents, at 4 byte aligned offset
+    template<typename T>
+    static void put(std::vector<char> &out,
+                    Header &header,
+                    SectionId id,
+                    const T *records,
+                    size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out.resize((out.size() + 3) & ~size_t(3));
+        header.sections[id] = {uint32_t(out.size()), uint32_t(count)};
+        const char *bytes = reinterpret_cast<const char *>(records);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    std::string GameCache::path_of(const std::string &protocol)
+    {
+        return protocol + EXTENSION;
+    }
+
+    void GameCache::write(const std::string &path,
+                          const Data::Game &game,
+                          const CacheSource &source)
+    {
+        Tables t;
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.source_size = source.size;
+        header.source_mtime = source.mtime;
+        header.source_hash = source.hash;
+        header.date = t.text(game.date);
+        header.place = t.text(game.place);
+        header.attendance = game.attendance;
+
+        for (const auto &referee : game.referees) {
+            t.referees.push_back({t.string(referee.name),
+                                  t.string(referee.surname),
+                                  uint32_t(referee.main)});
+        }
+
+        for (const auto &team : game.teams) {
+            TeamRecord record;
+            record.name = t.string(team.name);
+            record.players =
+                append(t.players, team.players, [&](const auto &p) {
+                    return PlayerRecord{t.string(p.name),
+                                        t.string(p.surname),
+                                        int32_t(p.p_type),
+                                        p.number};
+                });
+            record.substitutions =
+                append(t.substitutions, team.subsitutions, [](const auto &s) {
+                    return SubstitutionRecord{s.time, s.p_out, s.p_in};
+                });
+            record.starting_players = append(
+                t.starting_players, team.starting_players, [](int number) {
+                    return int32_t(number);
+                });
+            record.penalties =
+                append(t.penalties, team.penalties, [](const auto &p) {
+                    return PenaltyRecord{p.time, p.number};
+                });
+            record.goals = append(t.goals, team.goals, [&](const auto &g) {
+                const Range assists =
+                    append(t.assists, g.assists, [](int number) {
+                        return int32_t(number);
+                    });
+                return GoalRecord{
+                    g.time, g.number, uint32_t(g.from_game), assists};
+            });
+            t.teams.push_back(record);
+        }
+
+        buffer_.assign(sizeof(Header), 0);
+        put(buffer_, header, STRINGS, t.strings.data(), t.strings.size());
+        put(buffer_, header, CHARS, t.chars.data(), t.chars.size());
+        put(buffer_, header, REFEREES, t.referees.data(), t.referees.size());
+        put(buffer_, header, TEAMS, t.teams.data(), t.teams.size());
+        put(buffer_, header, PLAYERS, t.players.data(), t.players.size());
+        put(buffer_,
+            header,
+            SUBSTITUTIONS,
+            t.substitutions.data(),
+            t.substitutions.size());
+        put(buffer_,
+            header,
+            STARTING_PLAYERS,
+            t.starting_players.data(),
+            t.starting_players.size());
+        put(buffer_,
+            header,
+            PENALTIES,
+            t.penalties.data(),
+            t.penalties.size());
+        put(buffer_, header, GOALS, t.goals.data(), t.goals.size());
+        put(buffer_, header, ASSISTS, t.assists.data(), t.assists.size());
+        header.file_size = uint32_t(buffer_.size());
+        header.contents_hash = Utils::hash64(buffer_.data() + sizeof(Header),
+                                             buffer_.size() - sizeof(Header));
+        std::memcpy(buffer_.data(), &header, sizeof(header));
+
+        // Written aside and renamed, so readers never see half written file
+        const std::string temporary = path + TEMPORARY_EXTENSION;
+        {
+            std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+            ofs.write(buffer_.data(), std::streamsize(buffer_.size()));
+            if (!ofs)
+                throw std::runtime_error("Can not write '" + temporary + "'");
+        }
+        std::error_code ec;
+        std::filesystem::rename(temporary, path, ec);
+        if (ec) {
+            std::filesystem::remove(temporary, ec);
+            throw std::runtime_error("Can not write '" + path + "'");
+        }
+    }
+
+    /// Bounds checked access to records of the cache file
+    class CacheView {
+    public:
+        CacheView(const char *data, size_t size) : data_(data), size_(size)
+        {
+            if (size < sizeof(Header))
+                corrupted();
+            std::memcpy(&header_, data, sizeof(Header));
+        }
+
+        const Header &header() const { return header_; }
+
+        /// Checks that every section lies within the file
+        void check_sections() const
+        {
+            for (int id = 0; id < SECTION_COUNT; id++) {
+                const Section &s = header_.sections[id];
+                const uint64_t end =
+                    uint64_t(s.offset) + uint64_t(s.count) * RECORD_SIZES[id];
+                if (s.offset < sizeof(Header) or end > size_)
+                    corrupted();
+            }
+        }
+
+        size_t count(SectionId id) const { return header_.sections[id].count; }
+
+        /// \returns index-th record of the section
+        template<typename T>
+        T at(SectionId id, uint64_t index) const
+        {
+            const Section &s = header_.sections[id];
+            if (index >= s.count)
+                corrupted();
+            T record;
+            std::memcpy(
+                &record, data_ + s.offset + index * sizeof(T), sizeof(T));
+            return record;
+        }
+
+        /// \returns characters of string in CHARS section
+        std::string_view chars(const StringRecord &record) const
+        {
+            const Section &s = header_.sections[CHARS];
+            if (uint64_t(record.offset) + record.size > s.count)
+                corrupted();
+            return std::string_view(data_ + s.offset + record.offset,
+                                    record.size);
+        }
+
+    private:
+        const char *data_;
+        size_t size_;
+        Header header_;
+    };
+
+    /// Reserves room for the range in container, and calls f with every
+    /// record of the range
+    template<typename T, typename Container, typename F>
+    static void for_range(const CacheView &view,
+                          SectionId id,
+                          Range range,
+                          Container &container,
+                          F f)
+    {
+        // Checked upfront, so corrupted count does not reserve memory
+        if (uint64_t(range.first) + range.count > view.count(id))
+            corrupted();
+        container.reserve(range.count);
+        for (uint64_t i = 0; i < range.count; i++) {
+            f(view.at<T>(id, uint64_t(range.first) + i));
+        }
+    }
+
+    std::optional<std::string_view> GameCache::load(const std::string &path)
+    {
+        try {
+            const char *data = file_.open(path);
+            return std::string_view(data, file_.size());
+        }
+        catch (const std::runtime_error &) {
+            // No cache yet
+            return std::nullopt;
+        }
+    }
+
+    std::optional<Data::Game> GameCache::read(
+        const std::string &path,
+        CacheSource &source,
+        const std::function<uint64_t()> &hash_source,
+        const GameMemory &memory)
+    {
+        const auto contents = load(path);
+        if (!contents)
+            return std::nullopt;
+
+        try {
+            const char *data = contents->data();
+            const size_t size = contents->size();
+            const CacheView view(data, size);
+            const Header &header = view.header();
+            if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 or
+                header.version != VERSION or header.file_size != size or
+                header.source_size != source.size)
+                return std::nullopt;
+            if (header.source_mtime != source.mtime) {
+                // Copied or touched protocol, cache is still valid if
+                // contents are the same
+                source.hash = hash_source();
+                if (header.source_hash != source.hash)
+                    return std::nullopt;
+            }
+            if (Utils::hash64(data + sizeof(Header), size - sizeof(Header)) !=
+                header.contents_hash)
+                corrupted();
+            view.check_sections();
+
+            strings_.clear();
+            strings_.reserve(view.count(STRINGS));
+            for (size_t i = 0; i < view.count(STRINGS); i++) {
+                strings_.push_back(
+                    view.chars(view.at<StringRecord>(STRINGS, i)));
+            }
+            if (strings_.size() < GAME_TEXTS or header.date != 0 or
+                header.place != 1)
+                corrupted();
+            Data::Game game(strings_[header.date],
+                            strings_[header.place],
+                            header.attendance,
+                            memory);
+
+            // Every name is interned once, records refer to them by index.
+            // All names are interned at once, so the shared string table is
+            // locked once per game, not once per string.
+            memory.strings->intern(strings_.data() + GAME_TEXTS,
+                                   strings_.size() - GAME_TEXTS);
+            auto string = [&](uint32_t id) {
+                if (id < GAME_TEXTS or id >= strings_.size())
+                    corrupted();
+                return strings_[id];
+            };
+
+            game.referees.reserve(view.count(REFEREES));
+            for (size_t i = 0; i < view.count(REFEREES); i++) {
+                const auto r = view.at<RefereeRecord>(REFEREES, i);
+                game.referees.emplace_back(string(r.name), string(r.surname))
+                    .set_main(r.main != 0);
+            }
+
+            game.teams.reserve(view.count(TEAMS));
+            for (size_t i = 0; i < view.count(TEAMS); i++) {
+                const auto t = view.at<TeamRecord>(TEAMS, i);
+                auto &team = game.teams.emplace_back(string(t.name), memory);
+
+                for_range<PlayerRecord>(
+                    view,
+                    PLAYERS,
+                    t.players,
+                    team.players,
+                    [&](const PlayerRecord &p) {
+                        if (p.p_type < Data::ATTACKER or
+                            p.p_type > Data::GOALKEEPER)
+                            corrupted();
+                        team.players.emplace_back(string(p.name),
+                                                  string(p.surname),
+                                                  Data::PlayerType(p.p_type),
+                                                  p.number);
+                    });
+
+                for_range<SubstitutionRecord>(
+                    view,
+                    SUBSTITUTIONS,
+                    t.substitutions,
+                    team.subsitutions,
+                    [&](const SubstitutionRecord &s) {
+                        team.subsitutions.emplace_back(s.time, s.p_out, s.p_in);
+                    });
+
+                for_range<int32_t>(view,
+                                   STARTING_PLAYERS,
+                                   t.starting_players,
+                                   team.starting_players,
+                                   [&](int32_t number) {
+                                       team.starting_players.push_back(number);
+                                   });
+
+                for_range<PenaltyRecord>(
+                    view,
+                    PENALTIES,
+                    t.penalties,
+                    team.penalties,
+                    [&](const PenaltyRecord &p) {
+                        team.penalties.emplace_back(p.time, p.number);
+                    });
+
+                for_range<GoalRecord>(
+                    view, GOALS, t.goals, team.goals, [&](const GoalRecord &g) {
+                        auto &goal = team.goals.emplace_back(
+                            g.time, g.number, g.from_game != 0, memory);
+                        for_range<int32_t>(view,
+                                           ASSISTS,
+                                           g.assists,
+                                           goal.assists,
+                                           [&](int32_t number) {
+                                               goal.assists.push_back(number);
+                                           });
+                    });
+            }
+
+            source.hash = header.source_hash;
+            return game;
+        }
+        catch (const ParseError &) {
+            // Corrupted cache is parsed again from XML
+            return std::nullopt;
+        }
+    }
+}  // namespace LFL::XMLParser
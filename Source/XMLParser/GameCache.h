@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Arena.h"
+#include "InputFile.h"
+#include "Parser.h"
+
+namespace LFL::XMLParser {
+
+    /// Protocol file, the cache is written from
+    struct CacheSource {
+        /// Size in bytes
+        int64_t size;
+        /// Last write time, in ticks of std::filesystem clock
+        int64_t mtime;
+        /// Utils::hash64 of contents
+        uint64_t hash;
+    };
+
+    /// Binary cache of parsed protocols, kept next to XML file, so games are
+    /// read back without parsing XML again.
+    ///
+    /// Cache file starts with fixed size header (magic, layout version,
+    /// size, last write time and hash of XML file it was written from, hash
+    /// of the rest of the file, and offset and count of every section),
+    /// followed by sections of fixed width records: string table,
+    /// characters of all strings, referees, teams, and players, events and
+    /// assists of all teams, referenced by index ranges. Integers are in
+    /// host byte order, records are 4 byte aligned.
+    /// Not thread-safe, use one cache object per thread.
+    class GameCache {
+    public:
+        /// Layout version, caches of other versions are ignored
+        static constexpr uint32_t VERSION = 3;
+        /// Appended to the protocol file name
+        static constexpr const char *EXTENSION = ".lflc";
+        /// Appended to the cache file name, while it is being written
+        static constexpr const char *TEMPORARY_EXTENSION = ".tmp";
+
+        GameCache() = default;
+        GameCache(const GameCache &) = delete;
+        GameCache &operator=(const GameCache &) = delete;
+
+        /// \returns path of cache file of the protocol
+        static std::string path_of(const std::string &protocol);
+
+        /// Reads game from the cache file. Cache written from file of the
+        /// same size and last write time is valid without reading the
+        /// protocol. If only the time differs, contents hash decides.
+        /// \param source current size and last write time of the protocol,
+        /// hash is filled in if it is known: from the valid cache, or
+        /// computed
+        /// \param hash_source returns Utils::hash64 of protocol contents,
+        /// called only if needed
+        /// \returns game, or std::nullopt if there is no cache file, it is of
+        /// different version, was written from different contents or is
+        /// corrupted
+        std::optional<Data::Game> read(
+            const std::string &path,
+            CacheSource &source,
+            const std::function<uint64_t()> &hash_source,
+            const GameMemory &memory);
+
+        /// Writes game to the cache file, existing file is replaced
+        /// atomically.
+        /// \throws std::runtime_error if file can not be written
+        void write(const std::string &path,
+                   const Data::Game &game,
+                   const CacheSource &source);
+
+    private:
+        /// Opens cache file through file_ (memory mapped, if possible)
+        /// \returns contents of the file, valid until next load(),
+        /// std::nullopt if it can not be read
+        std::optional<std::string_view> load(const std::string &path);
+
+        InputFile file_;
+        /// Contents of the file being written
+        std::vector<char> buffer_;
+        std::vector<std::string_view> strings_;
+    };
+}  // namespace LFL::XMLParser
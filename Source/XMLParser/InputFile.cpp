@@ -0,0 +1,88 @@
+#include "InputFile.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace LFL::XMLParser {
+
+    InputFile::~InputFile() { close(); }
+
+    void InputFile::close()
+    {
+#ifndef _WIN32
+        if (mapping_ != nullptr) {
+            munmap(mapping_, size_ + 1);
+            mapping_ = nullptr;
+        }
+#endif
+        size_ = 0;
+    }
+
+    char *InputFile::open(const std::string &filename)
+    {
+        close();
+
+#ifndef _WIN32
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open file '" + filename + "'");
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat file '" + filename + "'");
+        }
+
+        const size_t size = static_cast<size_t>(st.st_size);
+        const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+        // Rest of the last page after end of file is filled with zeros,
+        // that is our terminator. Without it fall back to reading.
+        if (size != 0 and size % page_size != 0) {
+            void *mapping = mmap(nullptr,
+                                 size + 1,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE,
+                                 fd,
+                                 0);
+            if (mapping != MAP_FAILED) {
+                ::close(fd);
+                mapping_ = mapping;
+                size_ = size;
+                return static_cast<char *>(mapping_);
+            }
+        }
+        ::close(fd);
+#endif
+
+        return read(filename);
+    }
+
+    char *InputFile::read(const std::string &filename)
+    {
+        std::ifstream stream(filename, std::ios::binary);
+        if (!stream)
+            throw std::runtime_error("cannot open file '" + filename + "'");
+
+        stream.seekg(0, std::ios::end);
+        size_ = static_cast<size_t>(stream.tellg());
+        stream.seekg(0);
+
+        // resize() keeps capacity, so buffer is allocated only when file is
+        // bigger than all previous ones
+        buffer_.resize(size_ + 1);
+        stream.read(buffer_.data(), static_cast<std::streamsize>(size_));
+        if (!stream)
+            throw std::runtime_error("cannot read file '" + filename + "'");
+        buffer_[size_] = '\0';
+
+        return buffer_.data();
+    }
+}  // namespace LFL::XMLParser
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace LFL::XMLParser {
+
+    /// Writable, zero terminated contents of XML file, ready for in situ
+    /// rapidxml parsing.
+    /// File is memory mapped privately (copy-on-write), so parser modifies
+    /// mapped pages directly without reading whole file upfront. If mapping
+    /// is not possible (file size is multiple of page size, so there is no
+    /// room for terminating zero, or platform without mmap), file is read
+    /// into buffer, that is reused for following files.
+    class InputFile {
+    public:
+        InputFile() = default;
+        ~InputFile();
+        InputFile(const InputFile &) = delete;
+        InputFile &operator=(const InputFile &) = delete;
+
+        /// Opens new file, previously opened file is closed.
+        /// \returns zero terminated file contents, valid until next open()
+        /// or close().
+        /// \throws std::runtime_error if file can not be read.
+        char *open(const std::string &filename);
+        /// Releases mapping, buffer memory is kept for reuse.
+        void close();
+
+        /// \returns zero terminated contents of opened file, as returned by
+        /// open()
+        char *data()
+        {
+            return mapping_ != nullptr ? static_cast<char *>(mapping_)
+                                       : buffer_.data();
+        }
+        /// \returns size of opened file in bytes
+        size_t size() const { return size_; }
+        /// \returns true if opened file is memory mapped
+        bool mapped() const { return mapping_ != nullptr; }
+
+    private:
+        char *read(const std::string &filename);
+
+        void *mapping_ = nullptr;
+        size_t size_ = 0;
+        std::vector<char> buffer_;
+    };
+}  // namespace LFL::XMLParser
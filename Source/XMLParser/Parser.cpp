@@ -1,14 +1,113 @@
+#include <charconv>
+#include <cstddef>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <type_traits>
 
+#include "InputFile.h"
 #include "Parser.h"
+#include "Schema.h"
+#include "StreamParser.h"
+#include "Utils/Timing.h"
 
-#include "rapidxml_utils.hpp"
 
 namespace LFL::XMLParser {
     using rapidxml::xml_attribute;
     using rapidxml::xml_node;
 
+    AttributeView::AttributeView(xml_node<> *node) : node_(node)
+    {
+        assert(node != nullptr);
+    }
+
+    AttributeView::AttributeView(std::string_view element,
+                                 const Attribute *attributes,
+                                 size_t count)
+        : element_(element)
+        , attributes_(attributes)
+        , count_(count)
+    {
+    }
+
+    std::optional<std::string_view> AttributeView::find(
+        std::string_view name) const
+    {
+        assert(!name.empty());
+        if (node_ == nullptr) {
+            for (size_t i = 0; i < count_; i++) {
+                if (attributes_[i].name == name)
+                    return attributes_[i].value;
+            }
+            return std::nullopt;
+        }
+
+        const auto *attr = node_->first_attribute(name.data(), name.size());
+        if (attr == nullptr)
+            return std::nullopt;
+        return std::string_view(attr->value(), attr->value_size());
+    }
+
+    std::string_view AttributeView::element() const
+    {
+        if (node_ == nullptr)
+            return element_;
+        return std::string_view(node_->name(), node_->name_size());
+    }
+
+    std::string_view AttributeView::at(std::string_view name) const
+    {
+        const auto value = find(name);
+        if (!value) {
+            throw std::out_of_range("Node '" + std::string(element()) +
+                                    "' has no attribute '" +
+                                    std::string(name) + "'");
+        }
+        return *value;
+    }
+
+    bool AttributeView::contains(std::string_view name) const
+    {
+        return find(name).has_value();
+    }
+
+    int parse_int(std::string_view str)
+    {
+        int res = 0;
+        const char *end = str.data() + str.size();
+        // from_chars accepts leading minus, but all our numbers are positive
+        if (str.empty() or str.front() == '-') {
+            throw ParseError("Malformed number '" + std::string(str) + "'");
+        }
+        const auto [ptr, ec] = std::from_chars(str.data(), end, res);
+        if (ec != std::errc() or ptr != end) {
+            throw ParseError("Malformed number '" + std::string(str) + "'");
+        }
+        return res;
+    }
+
+    int parse_time(std::string_view str)
+    {
+        const auto div = str.find(':');
+        if (div == std::string_view::npos) {
+            throw ParseError("Malformed time '" + std::string(str) +
+                             "', expected mm:ss");
+        }
+
+        const int minutes = parse_int(str.substr(0, div));
+        const int seconds = parse_int(str.substr(div + 1));
+        if (seconds >= 60) {
+            throw ParseError("Malformed time '" + std::string(str) +
+                             "', seconds out of range");
+        }
+        // Result must fit to int with any seconds
+        if (minutes > (std::numeric_limits<int>::max() - 59) / 60) {
+            throw ParseError("Malformed time '" + std::string(str) +
+                             "', minutes out of range");
+        }
+        return minutes * 60 + seconds;
+    }
+
     StringsMap parse_node_attributes(xml_node<> *node)
     {
         assert(node != nullptr);
@@ -22,74 +121,189 @@ namespace LFL::XMLParser {
         return res;
     }
 
+    static size_t count_children(xml_node<> *node, const char *node_text)
+    {
+        size_t res = 0;
+        for (auto *son = node->first_node(node_text); son;
+             son = son->next_sibling(node_text)) {
+            res++;
+        }
+        return res;
+    }
+
     template<typename T>
-    static T parse_primitive_data_object(xml_node<> *node)
+    static T parse_primitive_data_object(xml_node<> *node,
+                                         const GameMemory &memory)
     {
-        const auto values = parse_node_attributes(node);
-        return T(values);
+        // Only objects with strings need the memory
+        if constexpr (std::is_constructible_v<T,
+                                              const AttributeView &,
+                                              const GameMemory &>) {
+            return T(AttributeView(node), memory);
+        }
+        else {
+            return T(AttributeView(node));
+        }
     }
     template<typename T>
-    static std::vector<T> parse_multiple_primitives(xml_node<> *node,
-                                                    const char *node_text)
+    static std::pmr::vector<T> parse_multiple_primitives(
+        xml_node<> *node,
+        const char *node_text,
+        const GameMemory &memory)
     {
-        std::vector<T> res;
+        // Exact size, so arena does not keep abandoned smaller buffers
+        std::pmr::vector<T> res(memory.resource);
+        res.reserve(count_children(node, node_text));
         for (auto *son = node->first_node(node_text); son;
              son = son->next_sibling(node_text)) {
-            res.emplace_back(parse_primitive_data_object<T>(son));
+            res.emplace_back(parse_primitive_data_object<T>(son, memory));
         }
         return res;
     }
 
     template<typename T>
-    static std::vector<T> parse_multiple_non_primitives(xml_node<> *node,
-                                                        const char *node_text)
+    static std::pmr::vector<T> parse_multiple_non_primitives(
+        xml_node<> *node,
+        const char *node_text,
+        const GameMemory &memory)
     {
-        std::vector<T> res;
+        std::pmr::vector<T> res(memory.resource);
+        res.reserve(count_children(node, node_text));
         for (auto *son = node->first_node(node_text); son;
              son = son->next_sibling(node_text)) {
-            res.emplace_back(T(son));
+            res.emplace_back(son, memory);
         }
         return res;
     }
 
-    Data::Game parse_game_file(const std::string &filename)
-    {
-        rapidxml::file<> file(filename.c_str());
-        rapidxml::xml_document<> doc;
-        doc.parse<0>(file.data());
+    /// rapidxml frees dynamic pool blocks on every clear(), keep them for the
+    /// next document parsed in this thread instead.
+    class PoolBlockCache {
+    public:
+        ~PoolBlockCache()
+        {
+            for (auto *block : blocks_) {
+                ::operator delete(block);
+            }
+        }
+
+        static void *allocate(std::size_t size)
+        {
+            auto &blocks = instance().blocks_;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                if (block_size(blocks[i]) == size) {
+                    void *block = blocks[i];
+                    blocks[i] = blocks.back();
+                    blocks.pop_back();
+                    return user_memory(block);
+                }
+            }
 
-        xml_node<> *root_game_node = doc.first_node("Spele");
-        if (root_game_node == nullptr) {
-            std::cerr << "XML is corrupted, there is no root node Spele!"
-                      << std::endl;
-            assert(false);
+            void *block = ::operator new(HEADER + size);
+            *static_cast<std::size_t *>(block) = size;
+            return user_memory(block);
         }
 
-        return Data::Game(root_game_node);
+        static void free(void *memory)
+        {
+            auto &blocks = instance().blocks_;
+            void *block = static_cast<char *>(memory) - HEADER;
+            if (blocks.size() < MAX_BLOCKS) {
+                blocks.push_back(block);
+            }
+            else {
+                ::operator delete(block);
+            }
+        }
+
+    private:
+        /// Block starts with its size, keeps user memory max aligned
+        static constexpr std::size_t HEADER = alignof(std::max_align_t);
+        static constexpr std::size_t MAX_BLOCKS = 16;
+
+        static PoolBlockCache &instance()
+        {
+            thread_local PoolBlockCache cache;
+            return cache;
+        }
+        static std::size_t block_size(void *block)
+        {
+            return *static_cast<std::size_t *>(block);
+        }
+        static void *user_memory(void *block)
+        {
+            return static_cast<char *>(block) + HEADER;
+        }
+
+        std::vector<void *> blocks_;
+    };
+
+    ParserContext::ParserContext(Frontend frontend)
+        : frontend_(frontend)
+        , stream_(std::make_unique<StreamParser>())
+    {
+        document_.set_allocator(PoolBlockCache::allocate, PoolBlockCache::free);
     }
-}  // namespace LFL::XMLParser
 
-namespace LFL::XMLParser::Data {
+    ParserContext::~ParserContext() = default;
+
+    Data::Game ParserContext::parse_game_file(const std::string &filename,
+                                              const GameMemory &memory)
+    {
+        {
+            Utils::ScopedTimer timer(Utils::Stage::READ);
+            input_.open(filename);
+        }
+        return parse_game_file(input_, memory);
+    }
 
-    static int parse_time_from_string(const std::string &str)
+    Data::Game ParserContext::parse_game_file(InputFile &input,
+                                              const GameMemory &memory)
     {
-        auto div = str.find(':');
+        char *text = input.data();
+
+        Utils::ScopedTimer timer(Utils::Stage::PARSE);
+        if (frontend_ == Frontend::STREAMING) {
+            Data::Game game = stream_->parse(text, memory);
+            input.close();
+            return game;
+        }
 
-        assert(div != std::string::npos);
-        return std::stoi(str.substr(0, div)) * 60 +
-               std::stoi(str.substr(div + 1));
+        // Pool memory from previous file is kept and reused
+        document_.clear();
+        document_.parse<0>(text);
+
+        xml_node<> *root_game_node = document_.first_node("Spele");
+        if (root_game_node == nullptr)
+            throw ParseError("XML is corrupted, there is no root node Spele!");
+
+        Data::Game game(root_game_node, memory);
+        // Game does not point into the file, it can be released right away
+        input.close();
+        return game;
     }
 
-    static bool parse_goal_type(const std::string &str)
+    Data::Game parse_game_file(const std::string &filename,
+                               const GameMemory &memory)
+    {
+        ParserContext context;
+        return context.parse_game_file(filename, memory);
+    }
+}  // namespace LFL::XMLParser
+
+namespace LFL::XMLParser::Data {
+
+    static bool parse_goal_type(std::string_view str, const GameMemory &)
     {
         if (str == "J")
             return false;
         if (str == "N")
             return true;
-        assert(false);
+        throw ParseError("Unknown goal type '" + std::string(str) + "'");
     }
 
-    static PlayerType parse_player_type_from_string(const std::string &str)
+    static PlayerType parse_player_type(std::string_view str,
+                                        const GameMemory &)
     {
         if (str == "U") {
             return PlayerType::ATTACKER;
@@ -101,106 +315,208 @@ namespace LFL::XMLParser::Data {
             return PlayerType::GOALKEEPER;
         }
         else {
-            std::cerr << "Unknown PlayerType '" << str << "'";
-            assert(false);
+            throw ParseError("Unknown PlayerType '" + std::string(str) + "'");
         }
     }
 
-    Person::Person(const StringsMap &attr)
-        : name(attr.at("Vards"))
-        , surname(attr.at("Uzvards"))
+    static std::string_view parse_name(std::string_view str,
+                                       const GameMemory &memory)
+    {
+        return memory.strings->intern(str);
+    }
+
+    static std::pmr::string parse_text(std::string_view str,
+                                       const GameMemory &memory)
+    {
+        return std::pmr::string(str, memory.resource);
+    }
+
+    static int parse_number(std::string_view str, const GameMemory &)
+    {
+        return parse_int(str);
+    }
+
+    static int parse_seconds(std::string_view str, const GameMemory &)
+    {
+        return parse_time(str);
+    }
+
+    /// Events have no strings, memory is not used
+    static const GameMemory NO_STRINGS;
+
+    // Attributes of protocol elements, one line per field
+    using Schema::field;
+    using Schema::fields;
+
+    static constexpr auto PERSON_FIELDS =
+        fields(field("Vards", &Person::name, parse_name),
+               field("Uzvards", &Person::surname, parse_name));
+    static constexpr auto PLAYER_FIELDS =
+        fields(field("Vards", &Person::name, parse_name),
+               field("Uzvards", &Person::surname, parse_name),
+               field("Loma", &Player::p_type, parse_player_type),
+               field("Nr", &Player::number, parse_number));
+    static constexpr auto TIMED_EVENT_FIELDS =
+        fields(field("Laiks", &TimedEvent::time, parse_seconds));
+    static constexpr auto SUBSTITUTION_FIELDS =
+        fields(field("Laiks", &TimedEvent::time, parse_seconds),
+               field("Nr1", &Substitution::p_out, parse_number),
+               field("Nr2", &Substitution::p_in, parse_number));
+    static constexpr auto PENALTY_FIELDS =
+        fields(field("Laiks", &TimedEvent::time, parse_seconds),
+               field("Nr", &Penalty::number, parse_number));
+    static constexpr auto GOAL_FIELDS =
+        fields(field("Laiks", &Goal::time, parse_seconds),
+               field("Nr", &Goal::number, parse_number),
+               field("Sitiens", &Goal::from_game, parse_goal_type));
+    static constexpr auto TEAM_FIELDS =
+        fields(field("Nosaukums", &Team::name, parse_name));
+    // Attendance (Skatitaji) is not read yet, every game has this one
+    static constexpr int DEFAULT_ATTENDANCE = 6740;
+    static constexpr auto GAME_FIELDS =
+        fields(field("Laiks", &Game::date, parse_text),
+               field("Vieta", &Game::place, parse_text));
+
+    Person::Person(const AttributeView &attr, const GameMemory &memory)
     {
+        Schema::bind(*this, attr, memory, PERSON_FIELDS);
     }
 
-    Player::Player(const StringsMap &attr)
-        : Person(attr)
-        , p_type(parse_player_type_from_string(attr.at("Loma")))
-        , number(std::stoi(attr.at("Nr")))
+    Player::Player(const AttributeView &attr, const GameMemory &memory)
     {
+        Schema::bind(*this, attr, memory, PLAYER_FIELDS);
     }
 
-    TimedEvent::TimedEvent(const StringsMap &attr)
-        : time(parse_time_from_string(attr.at("Laiks")))
+    TimedEvent::TimedEvent(const AttributeView &attr)
     {
+        Schema::bind(*this, attr, NO_STRINGS, TIMED_EVENT_FIELDS);
     }
 
-    Substitution::Substitution(const StringsMap &attr)
-        : TimedEvent(attr)
-        , p_out(std::stoi(attr.at("Nr1")))
-        , p_in(std::stoi(attr.at("Nr2")))
+    Substitution::Substitution(const AttributeView &attr)
     {
+        Schema::bind(*this, attr, NO_STRINGS, SUBSTITUTION_FIELDS);
     }
 
-    Penalty::Penalty(const StringsMap &attr)
-        : TimedEvent(attr)
-        , number(std::stoi(attr.at("Nr")))
+    Penalty::Penalty(const AttributeView &attr)
     {
+        Schema::bind(*this, attr, NO_STRINGS, PENALTY_FIELDS);
     }
 
-    Goal::Goal(rapidxml::xml_node<char> *node)
+    Goal::Goal(const AttributeView &attr, const GameMemory &memory)
+        : assists(memory.resource)
     {
-        const auto attr = parse_node_attributes(node);
+        Schema::bind(*this, attr, memory, GOAL_FIELDS);
+    }
 
-        time = parse_time_from_string(attr.at("Laiks"));
-        number = std::stoi(attr.at("Nr"));
-        from_game = parse_goal_type(attr.at("Sitiens"));
+    Goal::Goal(int time_,
+               int number_,
+               bool from_game_,
+               const GameMemory &memory)
+        : time(time_)
+        , number(number_)
+        , from_game(from_game_)
+        , assists(memory.resource)
+    {
+    }
 
+    Goal::Goal(rapidxml::xml_node<char> *node, const GameMemory &memory)
+        : Goal(AttributeView(node), memory)
+    {
+        assists.reserve(count_children(node, "P"));
         for (auto *son = node->first_node("P"); son;
              son = son->next_sibling("P")) {
-            assists.emplace_back(
-                std::stoi(XMLParser::parse_node_attributes(son).at("Nr")));
+            assists.emplace_back(parse_int(AttributeView(son).at("Nr")));
         }
     }
 
-    Team::Team(rapidxml::xml_node<> *node)
+    Team::Team(const AttributeView &attr, const GameMemory &memory)
+        : players(memory.resource)
+        , subsitutions(memory.resource)
+        , starting_players(memory.resource)
+        , penalties(memory.resource)
+        , goals(memory.resource)
     {
-        const auto attr = parse_node_attributes(node);
+        Schema::bind(*this, attr, memory, TEAM_FIELDS);
+    }
 
-        name = attr.at("Nosaukums");
+    Team::Team(std::string_view name_, const GameMemory &memory)
+        : name(name_)
+        , players(memory.resource)
+        , subsitutions(memory.resource)
+        , starting_players(memory.resource)
+        , penalties(memory.resource)
+        , goals(memory.resource)
+    {
+    }
 
+    Team::Team(rapidxml::xml_node<> *node, const GameMemory &memory)
+        : Team(AttributeView(node), memory)
+    {
         if (auto subnode = node->first_node("Speletaji")) {
-            players = parse_multiple_primitives<Player>(subnode, "Speletajs");
+            players = parse_multiple_primitives<Player>(
+                subnode, "Speletajs", memory);
         }
         else {
-            std::cerr << "XML is corrupted, there is no Speletaji subnode!";
-            assert(false);
+            throw ParseError(
+                "XML is corrupted, there is no Speletaji subnode!");
         }
         if (auto subnode = node->first_node("Mainas")) {
-            subsitutions =
-                parse_multiple_primitives<Substitution>(subnode, "Maina");
+            subsitutions = parse_multiple_primitives<Substitution>(
+                subnode, "Maina", memory);
         }
         if (auto subnode = node->first_node("Pamatsastavs")) {
+            starting_players.reserve(count_children(subnode, "Speletajs"));
             for (auto *son = subnode->first_node("Speletajs"); son;
                  son = son->next_sibling("Speletajs")) {
                 starting_players.push_back(
-                    std::stoi(parse_node_attributes(son).at("Nr")));
+                    parse_int(AttributeView(son).at("Nr")));
             }
         }
         else {
-            std::cerr << "XML is corrupted, there is no Pamatsastavs subnode!";
-            assert(false);
+            throw ParseError(
+                "XML is corrupted, there is no Pamatsastavs subnode!");
         }
         if (auto subnode = node->first_node("Sodi")) {
-            penalties = parse_multiple_primitives<Penalty>(subnode, "Sods");
+            penalties =
+                parse_multiple_primitives<Penalty>(subnode, "Sods", memory);
         }
         if (auto subnode = node->first_node("Varti")) {
-            goals = parse_multiple_non_primitives<Goal>(subnode, "VG");
+            goals =
+                parse_multiple_non_primitives<Goal>(subnode, "VG", memory);
         }
     }
 
-    Game::Game(rapidxml::xml_node<> *node)
+    Game::Game(const AttributeView &attr, const GameMemory &memory)
+        : date(memory.resource)
+        , attendance(DEFAULT_ATTENDANCE)
+        , place(memory.resource)
+        , teams(memory.resource)
+        , referees(memory.resource)
     {
-        const auto attr = parse_node_attributes(node);
+        Schema::bind(*this, attr, memory, GAME_FIELDS);
+    }
 
-        date = attr.at("Laiks");
-        place = attr.at("Vieta");
-        attendance = std::stoi("6740");
+    Game::Game(std::string_view date_,
+               std::string_view place_,
+               int attendance_,
+               const GameMemory &memory)
+        : date(date_, memory.resource)
+        , attendance(attendance_)
+        , place(place_, memory.resource)
+        , teams(memory.resource)
+        , referees(memory.resource)
+    {
+    }
 
-        teams = parse_multiple_non_primitives<Team>(node, "Komanda");
-        referees = parse_multiple_primitives<Referee>(node, "T");
+    Game::Game(rapidxml::xml_node<> *node, const GameMemory &memory)
+        : Game(AttributeView(node), memory)
+    {
+        teams = parse_multiple_non_primitives<Team>(node, "Komanda", memory);
+        referees = parse_multiple_primitives<Referee>(node, "T", memory);
 
         if (auto subnode = node->first_node("VT")) {
-            Referee main_ref = parse_primitive_data_object<Referee>(subnode);
+            Referee main_ref =
+                parse_primitive_data_object<Referee>(subnode, memory);
             main_ref.set_main(true);
             referees.emplace_back(main_ref);
         }
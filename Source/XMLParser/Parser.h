@@ -2,14 +2,88 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "Arena.h"
+#include "InputFile.h"
 #include "rapidxml.hpp"
 
 namespace LFL::XMLParser {
     typedef std::map<std::string, std::string> StringsMap;
 
+    /// Thrown when XML protocol contains malformed attribute value.
+    class ParseError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /// Parses non negative decimal integer (Nr, Nr1, Nr2 attributes).
+    /// \throws ParseError if whole string is not a number
+    int parse_int(std::string_view str);
+    /// Parses "mm:ss" time (Laiks attribute).
+    /// \returns seconds from start of the match
+    /// \throws ParseError if time is malformed
+    int parse_time(std::string_view str);
+
+    /// Attribute of XML element, as collected by StreamParser
+    struct Attribute {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    /// Non-owning view of XML node attributes. Looks attributes up directly
+    /// in rapidxml node (or in attributes collected by StreamParser), so
+    /// nothing is copied or allocated.
+    /// Must not outlive the parsed document.
+    class AttributeView {
+    public:
+        explicit AttributeView(rapidxml::xml_node<> *node);
+        AttributeView(std::string_view element,
+                      const Attribute *attributes,
+                      size_t count);
+
+        /// \returns attribute value, std::string_view pointing inside of the
+        /// parsed document.
+        /// \throws std::out_of_range if there is no such attribute.
+        std::string_view at(std::string_view name) const;
+        /// \returns true if node has given attribute
+        bool contains(std::string_view name) const;
+        /// \returns name of the node
+        std::string_view element() const;
+
+        /// Calls f(name, value) for every attribute, in document order
+        template<typename F>
+        void for_each(F &&f) const
+        {
+            if (node_ == nullptr) {
+                for (size_t i = 0; i < count_; i++) {
+                    f(attributes_[i].name, attributes_[i].value);
+                }
+                return;
+            }
+            for (auto *attr = node_->first_attribute(); attr;
+                 attr = attr->next_attribute()) {
+                f(std::string_view(attr->name(), attr->name_size()),
+                  std::string_view(attr->value(), attr->value_size()));
+            }
+        }
+
+    private:
+        std::optional<std::string_view> find(std::string_view name) const;
+
+        rapidxml::xml_node<> *node_ = nullptr;
+        /// Used if there is no node
+        std::string_view element_;
+        const Attribute *attributes_ = nullptr;
+        size_t count_ = 0;
+    };
+
     namespace Data {
         enum PlayerType { ATTACKER = 0, DEFENDER = 1, GOALKEEPER = 2 };
         /// Base XML parsable object
@@ -26,10 +100,21 @@ namespace LFL::XMLParser {
         /// Base class for all human classes.
         class Person : public PrimitiveParsableObject {
         public:
-            std::string name;
-            std::string surname;
+            /// Interned, see LFL::XMLParser::StringTable
+            std::string_view name;
+            std::string_view surname;
 
-            Person(const StringsMap &attr);
+            Person(const AttributeView &attr, const GameMemory &memory);
+            /// Names must be interned (or outlive the object)
+            Person(std::string_view name_, std::string_view surname_)
+                : name(name_)
+                , surname(surname_)
+            {
+            }
+
+        protected:
+            /// Fields are bound by derived class
+            Person() = default;
         };
         class Referee : public Person {
         public:
@@ -43,7 +128,16 @@ namespace LFL::XMLParser {
             PlayerType p_type;
             int number;
 
-            Player(const StringsMap &attr);
+            Player(const AttributeView &attr, const GameMemory &memory);
+            Player(std::string_view name_,
+                   std::string_view surname_,
+                   PlayerType p_type_,
+                   int number_)
+                : Person(name_, surname_)
+                , p_type(p_type_)
+                , number(number_)
+            {
+            }
         };
         /// Base class for almost all timed events
         /// the only exception is non-primitive Goal class.
@@ -52,57 +146,141 @@ namespace LFL::XMLParser {
             /// In seconds from start of the match
             int time;
 
-            TimedEvent(const StringsMap &attr);
+            TimedEvent(const AttributeView &attr);
+            explicit TimedEvent(int time_) : time(time_) {}
+
+        protected:
+            /// Fields are bound by derived class
+            TimedEvent() = default;
         };
         class Substitution : public TimedEvent {
         public:
             int p_out;
             int p_in;
 
-            Substitution(const StringsMap &attr);
+            Substitution(const AttributeView &attr);
+            Substitution(int time_, int p_out_, int p_in_)
+                : TimedEvent(time_)
+                , p_out(p_out_)
+                , p_in(p_in_)
+            {
+            }
         };
         class Penalty : public TimedEvent {
         public:
             int number;
 
-            Penalty(const StringsMap &attr);
+            Penalty(const AttributeView &attr);
+            Penalty(int time_, int number_)
+                : TimedEvent(time_)
+                , number(number_)
+            {
+            }
         };
         class Goal : public ParsableObject {
         public:
             int time;
             int number;
             bool from_game;
-            std::vector<int> assists;
+            std::pmr::vector<int> assists;
 
-            Goal(rapidxml::xml_node<> *node);
+            /// Goal without assists, they are added by the caller
+            Goal(const AttributeView &attr, const GameMemory &memory);
+            Goal(int time_,
+                 int number_,
+                 bool from_game_,
+                 const GameMemory &memory);
+            Goal(rapidxml::xml_node<> *node, const GameMemory &memory);
         };
         class Team : public ParsableObject {
         public:
-            std::string name;
-            std::vector<Player> players;
-            std::vector<Substitution> subsitutions;
-            std::vector<int> starting_players;
-            std::vector<Penalty> penalties;
-            std::vector<Goal> goals;
-
-            Team(rapidxml::xml_node<> *node);
+            std::string_view name;
+            std::pmr::vector<Player> players;
+            std::pmr::vector<Substitution> subsitutions;
+            std::pmr::vector<int> starting_players;
+            std::pmr::vector<Penalty> penalties;
+            std::pmr::vector<Goal> goals;
+
+            /// Named team with no players and events, they are added by the
+            /// caller
+            Team(const AttributeView &attr, const GameMemory &memory);
+            /// Name must be interned (or outlive the object)
+            Team(std::string_view name_, const GameMemory &memory);
+            Team(rapidxml::xml_node<> *node, const GameMemory &memory);
         };
+        /// Whole parsed protocol. All containers are allocated from
+        /// GameMemory::resource given to the parser, so game must not outlive
+        /// it (e.g. GameArena::reset()).
         class Game : public ParsableObject {
         public:
-            std::string date;
+            /// Date and place are different in every game, they are copied
+            /// to GameMemory::resource instead of being interned
+            std::pmr::string date;
             int attendance;
-            std::string place;
-            std::vector<Team> teams;
-            std::vector<Referee> referees;
+            std::pmr::string place;
+            std::pmr::vector<Team> teams;
+            std::pmr::vector<Referee> referees;
 
-            Game(rapidxml::xml_node<> *node);
+            /// Game without teams and referees, they are added by the caller
+            Game(const AttributeView &attr, const GameMemory &memory);
+            /// Date and place are copied, other strings must be interned
+            /// (or outlive the object)
+            Game(std::string_view date_,
+                 std::string_view place_,
+                 int attendance_,
+                 const GameMemory &memory);
+            Game(rapidxml::xml_node<> *node, const GameMemory &memory);
         };
 
     }  // namespace Data
 
+    class StreamParser;
+
     /// Returns XML node attributes as std::string dictionary (map).
+    /// \see AttributeView for non allocating access
     StringsMap parse_node_attributes(rapidxml::xml_node<> *node);
-    /// Traverses and parse all XML tree
-    /// \return Parsed and ready to consume LFL::Data::Game objects
-    Data::Game parse_game_file(const std::string &filename);
+    /// How protocols are parsed
+    enum class Frontend {
+        /// Single pass, see LFL::XMLParser::StreamParser
+        STREAMING,
+        /// rapidxml document is built first, then Data objects from it
+        DOM
+    };
+
+    /// Reusable state for parsing many files one after another: input
+    /// buffers and parser state (rapidxml document with its memory pool, or
+    /// stream parser buffers) are kept between files, so in steady state
+    /// parsing does not allocate.
+    /// Not thread-safe, use one context per thread.
+    class ParserContext {
+    public:
+        explicit ParserContext(Frontend frontend = Frontend::STREAMING);
+        ~ParserContext();
+        ParserContext(const ParserContext &) = delete;
+        ParserContext &operator=(const ParserContext &) = delete;
+
+        /// Traverses and parse all XML tree
+        /// \param memory where to allocate parsed game, by default it is
+        /// allocated on heap, pass GameArena::memory() to reuse memory
+        /// between files.
+        /// \return Parsed and ready to consume LFL::Data::Game objects
+        Data::Game parse_game_file(const std::string &filename,
+                                   const GameMemory &memory = GameMemory());
+        /// Parses file already opened by input (e.g. to hash its contents),
+        /// so it is not read again. Contents are modified in place, and
+        /// input is closed after parsing.
+        Data::Game parse_game_file(InputFile &input,
+                                   const GameMemory &memory = GameMemory());
+
+    private:
+        Frontend frontend_;
+        InputFile input_;
+        rapidxml::xml_document<> document_;
+        std::unique_ptr<StreamParser> stream_;
+    };
+
+    /// Parses single file with temporary ParserContext.
+    /// \see ParserContext::parse_game_file
+    Data::Game parse_game_file(const std::string &filename,
+                               const GameMemory &memory = GameMemory());
 }  // namespace LFL::XMLParser
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "Arena.h"
+#include "Parser.h"
+
+/// Compile time description of the protocol: every element and attribute
+/// name, and which attribute goes to which member of LFL::XMLParser::Data
+/// objects.
+namespace LFL::XMLParser::Schema {
+
+    /// Every element and attribute name used in protocols
+    inline constexpr std::string_view NAMES[] = {
+        // Elements
+        "Spele", "Komanda", "Speletaji", "Speletajs", "Mainas", "Maina",
+        "Pamatsastavs", "Sodi", "Sods", "Varti", "VG", "P", "T", "VT",
+        // Attributes
+        "Laiks", "Vieta", "Skatitaji", "Nosaukums", "Vards", "Uzvards", "Loma",
+        "Nr", "Nr1", "Nr2", "Sitiens",
+    };
+    inline constexpr size_t NAME_COUNT = std::size(NAMES);
+
+    /// Slots of the perfect hash table, power of two
+    inline constexpr size_t SLOT_COUNT = 64;
+    static_assert(NAME_COUNT <= SLOT_COUNT);
+
+    /// FNV-1a with seed
+    constexpr uint32_t hash(std::string_view name, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : name) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 16777619u;
+        }
+        return (h ^ (h >> 16)) & (SLOT_COUNT - 1);
+    }
+
+    /// \returns first seed, for which no two names hash to the same slot
+    constexpr uint32_t find_seed()
+    {
+        for (uint32_t seed = 0;; seed++) {
+            bool used[SLOT_COUNT] = {};
+            bool collision = false;
+            for (size_t i = 0; i < NAME_COUNT and !collision; i++) {
+                const uint32_t slot = hash(NAMES[i], seed);
+                collision = used[slot];
+                used[slot] = true;
+            }
+            if (!collision)
+                return seed;
+        }
+    }
+    inline constexpr uint32_t SEED = find_seed();
+
+    /// Index to NAMES of name in every slot, -1 if slot is empty
+    constexpr std::array<int8_t, SLOT_COUNT> make_slots()
+    {
+        std::array<int8_t, SLOT_COUNT> res = {};
+        for (auto &slot : res) {
+            slot = -1;
+        }
+        for (size_t i = 0; i < NAME_COUNT; i++) {
+            res[hash(NAMES[i], SEED)] = static_cast<int8_t>(i);
+        }
+        return res;
+    }
+    inline constexpr std::array<int8_t, SLOT_COUNT> SLOTS = make_slots();
+
+    /// \returns index of name in NAMES, -1 for names out of the schema.
+    /// Costs one hash and one string compare.
+    constexpr int name_id(std::string_view name)
+    {
+        const int id = SLOTS[hash(name, SEED)];
+        return id >= 0 and NAMES[id] == name ? id : -1;
+    }
+
+    /// Converts attribute value to member type
+    template<typename M>
+    using ValueParser = M (*)(std::string_view value,
+                              const GameMemory &memory);
+
+    /// Required attribute stored to member of class C
+    template<typename C, typename M>
+    struct Field {
+        std::string_view name;
+        int id;
+        M C::*member;
+        ValueParser<M> parse;
+    };
+
+    template<typename C, typename M>
+    constexpr Field<C, M> field(std::string_view name,
+                                M C::*member,
+                                ValueParser<M> parse)
+    {
+        const int id = name_id(name);
+        if (id < 0)
+            throw std::logic_error("Attribute is not in Schema::NAMES");
+        return Field<C, M>{name, id, member, parse};
+    }
+
+    /// Fields of object, std::tuple of Field
+    template<typename... Fields>
+    constexpr auto fields(Fields... f)
+    {
+        static_assert(sizeof...(Fields) <= 32, "Too many fields");
+        return std::make_tuple(f...);
+    }
+
+    /// Stores attributes to the object, walking them only once. Attributes
+    /// out of the schema are ignored, only the first of repeated ones is
+    /// used.
+    /// \throws std::out_of_range if some field is missing
+    /// \throws ParseError if attribute value is malformed
+    template<typename T, typename... Fields>
+    void bind(T &object,
+              const AttributeView &attr,
+              const GameMemory &memory,
+              const std::tuple<Fields...> &schema)
+    {
+        constexpr uint32_t ALL = uint32_t((1ull << sizeof...(Fields)) - 1);
+        uint32_t bound = 0;
+
+        attr.for_each([&](std::string_view name, std::string_view value) {
+            const int id = name_id(name);
+            if (id < 0)
+                return;
+
+            std::apply(
+                [&](const auto &...schema_fields) {
+                    uint32_t bit = 1;
+                    auto try_bind = [&](const auto &f) {
+                        const uint32_t mask = bit;
+                        bit <<= 1;
+                        if (f.id != id or (bound & mask))
+                            return false;
+                        object.*f.member = f.parse(value, memory);
+                        bound |= mask;
+                        return true;
+                    };
+                    (try_bind(schema_fields) or ...);
+                },
+                schema);
+        });
+
+        if (bound == ALL)
+            return;
+        // Reports the first missing field, the same way as AttributeView
+        std::apply(
+            [&](const auto &...schema_fields) {
+                uint32_t bit = 1;
+                auto check = [&](const auto &f) {
+                    if (!(bound & bit))
+                        attr.at(f.name);
+                    bit <<= 1;
+                };
+                (check(schema_fields), ...);
+            },
+            schema);
+    }
+}  // namespace LFL::XMLParser::Schema
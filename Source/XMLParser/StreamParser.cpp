@@ -0,0 +1,512 @@
+#include "StreamParser.h"
+
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "Schema.h"
+
+namespace LFL::XMLParser {
+
+    [[noreturn]] static void malformed(const std::string &what)
+    {
+        throw ParseError("Malformed XML, " + what);
+    }
+
+    static bool is_space(char c)
+    {
+        return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+    }
+
+    /// Names end at whitespace or markup, terminating zero included
+    static bool is_name_end(char c)
+    {
+        return is_space(c) or c == '/' or c == '>' or c == '=' or c == '\0';
+    }
+
+    static char *skip_space(char *p)
+    {
+        while (is_space(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    static char *skip_name(char *p)
+    {
+        while (!is_name_end(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    /// \returns position right after the first occurrence of end
+    static char *skip_past(char *p, const char *end)
+    {
+        char *found = std::strstr(p, end);
+        if (found == nullptr) {
+            malformed("missing '" + std::string(end) + "'");
+        }
+        return found + std::strlen(end);
+    }
+
+    /// Skips <!DOCTYPE ...> and alike, including internal subset in []
+    static char *skip_declaration(char *p)
+    {
+        int depth = 0;
+        for (; *p != '\0'; p++) {
+            if (*p == '[')
+                depth++;
+            else if (*p == ']')
+                depth--;
+            else if (*p == '>' and depth <= 0)
+                return p + 1;
+        }
+        malformed("unterminated declaration");
+    }
+
+    static bool starts_with(const char *p, std::string_view prefix)
+    {
+        return std::strncmp(p, prefix.data(), prefix.size()) == 0;
+    }
+
+    /// Writes code point as UTF-8
+    /// \returns position after written bytes
+    static char *write_utf8(char *out, unsigned long code)
+    {
+        if (code < 0x80) {
+            *out++ = static_cast<char>(code);
+        }
+        else if (code < 0x800) {
+            *out++ = static_cast<char>(0xC0 | (code >> 6));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000) {
+            *out++ = static_cast<char>(0xE0 | (code >> 12));
+            *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x110000) {
+            *out++ = static_cast<char>(0xF0 | (code >> 18));
+            *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else {
+            malformed("invalid numeric character entity");
+        }
+        return out;
+    }
+
+    /// Replaces character and entity references in [begin, end) the same
+    /// way rapidxml does, unknown entities are kept as they are.
+    /// \returns decoded value, it is never longer than original
+    static std::string_view decode_entities(char *begin, char *end)
+    {
+        char *in = static_cast<char *>(std::memchr(begin, '&', end - begin));
+        if (in == nullptr)
+            return std::string_view(begin, end - begin);
+
+        static const std::pair<std::string_view, char> NAMED[] = {
+            {"&amp;", '&'},
+            {"&lt;", '<'},
+            {"&gt;", '>'},
+            {"&quot;", '"'},
+            {"&apos;", '\''},
+        };
+
+        char *out = in;
+        while (in < end) {
+            if (*in != '&') {
+                *out++ = *in++;
+                continue;
+            }
+
+            const std::string_view rest(in, end - in);
+            bool decoded = false;
+            for (const auto &[entity, c] : NAMED) {
+                if (rest.substr(0, entity.size()) == entity) {
+                    *out++ = c;
+                    in += entity.size();
+                    decoded = true;
+                    break;
+                }
+            }
+            if (decoded)
+                continue;
+
+            if (rest.size() > 2 and rest[1] == '#') {
+                const bool hex = rest[2] == 'x';
+                const char *digits = in + (hex ? 3 : 2);
+                // Unlike strtoul, from_chars takes no whitespace nor sign
+                unsigned long code = 0;
+                const auto [digits_end, ec] =
+                    std::from_chars(digits, end, code, hex ? 16 : 10);
+                if (ec != std::errc()) {
+                    malformed("invalid numeric character entity");
+                }
+                if (digits_end >= end or *digits_end != ';') {
+                    malformed("expected ';' after numeric character entity");
+                }
+                out = write_utf8(out, code);
+                in += digits_end - in + 1;
+                continue;
+            }
+
+            *out++ = *in++;
+        }
+        return std::string_view(begin, out - begin);
+    }
+
+    using Data::Game;
+    using Data::Goal;
+    using Data::Referee;
+    using Data::Team;
+
+    const StreamParser::Rule StreamParser::SCHEMA[] = {
+        {Scope::DOCUMENT, "Spele", Scope::GAME,
+         &StreamParser::open_game, &StreamParser::close_game},
+        {Scope::GAME, "Komanda", Scope::TEAM,
+         &StreamParser::open_team, &StreamParser::close_team},
+        {Scope::GAME, "T", Scope::LEAF,
+         &StreamParser::open_referee, nullptr},
+        {Scope::GAME, "VT", Scope::LEAF,
+         &StreamParser::open_main_referee, nullptr},
+        {Scope::TEAM, "Speletaji", Scope::PLAYERS,
+         &StreamParser::open_players, nullptr},
+        {Scope::PLAYERS, "Speletajs", Scope::LEAF,
+         &StreamParser::open_player, nullptr},
+        {Scope::TEAM, "Mainas", Scope::SUBSTITUTIONS, nullptr, nullptr},
+        {Scope::SUBSTITUTIONS, "Maina", Scope::LEAF,
+         &StreamParser::open_substitution, nullptr},
+        {Scope::TEAM, "Pamatsastavs", Scope::STARTING_PLAYERS,
+         &StreamParser::open_starting_players, nullptr},
+        {Scope::STARTING_PLAYERS, "Speletajs", Scope::LEAF,
+         &StreamParser::open_starting_player, nullptr},
+        {Scope::TEAM, "Sodi", Scope::PENALTIES, nullptr, nullptr},
+        {Scope::PENALTIES, "Sods", Scope::LEAF,
+         &StreamParser::open_penalty, nullptr},
+        {Scope::TEAM, "Varti", Scope::GOALS, nullptr, nullptr},
+        {Scope::GOALS, "VG", Scope::GOAL,
+         &StreamParser::open_goal, &StreamParser::close_goal},
+        {Scope::GOAL, "P", Scope::LEAF, &StreamParser::open_assist, nullptr},
+    };
+
+    const StreamParser::Rule *StreamParser::find_rule(Scope parent,
+                                                      std::string_view element)
+    {
+        // Index to SCHEMA by parent scope and element name, -1 if element
+        // is not expected there
+        using ScopeRules = std::array<int8_t, Schema::NAME_COUNT>;
+        static const auto index = [] {
+            std::array<ScopeRules, size_t(Scope::SKIPPED) + 1> res;
+            for (auto &rules : res) {
+                rules.fill(-1);
+            }
+            for (size_t i = 0; i < std::size(SCHEMA); i++) {
+                const int id = Schema::name_id(SCHEMA[i].element);
+                assert(id >= 0);
+                res[size_t(SCHEMA[i].parent)][id] = static_cast<int8_t>(i);
+            }
+            return res;
+        }();
+
+        const int id = Schema::name_id(element);
+        if (id < 0)
+            return nullptr;
+        const int rule = index[size_t(parent)][id];
+        return rule < 0 ? nullptr : &SCHEMA[rule];
+    }
+
+    Data::Game StreamParser::parse(char *text, const GameMemory &memory)
+    {
+        memory_ = &memory;
+        try {
+            parse_document(text);
+        }
+        catch (...) {
+            reset();
+            throw;
+        }
+
+        if (!game_) {
+            reset();
+            throw ParseError("XML is corrupted, there is no root node Spele!");
+        }
+        Game game = std::move(*game_);
+        reset();
+        return game;
+    }
+
+    void StreamParser::parse_document(char *text)
+    {
+        char *p = text;
+        // UTF-8 byte order mark
+        if (starts_with(p, "\xEF\xBB\xBF"))
+            p += 3;
+
+        // Text between elements is not part of the protocol, only markup
+        // is read
+        while ((p = std::strchr(p, '<')) != nullptr) {
+            p++;
+
+            if (*p == '?') {
+                p = skip_past(p, "?>");
+                continue;
+            }
+            if (*p == '!') {
+                if (starts_with(p, "!--"))
+                    p = skip_past(p + 3, "-->");
+                else if (starts_with(p, "![CDATA["))
+                    p = skip_past(p, "]]>");
+                else
+                    p = skip_declaration(p);
+                continue;
+            }
+
+            if (*p == '/') {
+                char *name = ++p;
+                p = skip_name(p);
+                const std::string_view element(name, p - name);
+                p = skip_space(p);
+                if (*p != '>')
+                    malformed("expected '>' after '</" +
+                              std::string(element) + "'");
+                p++;
+                end_element(element);
+                continue;
+            }
+
+            char *name = p;
+            p = skip_name(p);
+            if (p == name)
+                malformed("expected element name");
+            const std::string_view element(name, p - name);
+
+            const Rule *rule = find_rule(
+                stack_.empty() ? Scope::DOCUMENT : stack_.back().scope,
+                element);
+            // Attributes of skipped elements are not decoded
+            const bool used = rule != nullptr and rule->open != nullptr;
+
+            attributes_.clear();
+            while (true) {
+                p = skip_space(p);
+                if (*p == '>') {
+                    p++;
+                    start_element(element, rule, false);
+                    break;
+                }
+                if (*p == '/') {
+                    if (p[1] != '>')
+                        malformed("expected '/>' in '" +
+                                  std::string(element) + "'");
+                    p += 2;
+                    start_element(element, rule, true);
+                    break;
+                }
+
+                char *attr = p;
+                p = skip_name(p);
+                if (p == attr)
+                    malformed("expected attribute name in '" +
+                              std::string(element) + "'");
+                const std::string_view attr_name(attr, p - attr);
+
+                p = skip_space(p);
+                if (*p != '=')
+                    malformed("expected '=' after '" +
+                              std::string(attr_name) + "'");
+                p = skip_space(p + 1);
+
+                const char quote = *p;
+                if (quote != '"' and quote != '\'')
+                    malformed("expected quote after '" +
+                              std::string(attr_name) + "='");
+                char *value = ++p;
+                p = std::strchr(p, quote);
+                if (p == nullptr)
+                    malformed("unterminated value of '" +
+                              std::string(attr_name) + "'");
+
+                if (used) {
+                    attributes_.push_back(
+                        {attr_name, decode_entities(value, p)});
+                }
+                p++;
+            }
+        }
+
+        if (!stack_.empty()) {
+            malformed("element '" + std::string(stack_.back().name) +
+                      "' is not closed");
+        }
+    }
+
+    void StreamParser::start_element(std::string_view name,
+                                     const Rule *rule,
+                                     bool empty)
+    {
+        stack_.push_back({name, rule ? rule->scope : Scope::SKIPPED, rule});
+        if (rule != nullptr and rule->open != nullptr) {
+            (this->*rule->open)(
+                AttributeView(name, attributes_.data(), attributes_.size()));
+        }
+        if (empty)
+            end_element(name);
+    }
+
+    void StreamParser::end_element(std::string_view name)
+    {
+        if (stack_.empty() or stack_.back().name != name) {
+            malformed("unexpected end of element '" + std::string(name) +
+                      "'");
+        }
+        const Rule *rule = stack_.back().rule;
+        stack_.pop_back();
+        if (rule != nullptr and rule->close != nullptr)
+            (this->*rule->close)();
+    }
+
+    void StreamParser::reset()
+    {
+        // Parsed objects may use memory of the caller, nothing is kept
+        // after parse() returns
+        stack_.clear();
+        attributes_.clear();
+        game_.reset();
+        teams_.clear();
+        referees_.clear();
+        main_referee_.reset();
+        team_.reset();
+        players_.clear();
+        substitutions_.clear();
+        starting_players_.clear();
+        penalties_.clear();
+        goals_.clear();
+        goal_.reset();
+        assists_.clear();
+    }
+
+    void StreamParser::open_game(const AttributeView &attr)
+    {
+        if (game_)
+            malformed("more than one root element 'Spele'");
+        game_.emplace(attr, *memory_);
+    }
+
+    void StreamParser::close_game()
+    {
+        // Main referee is the last one, as in the DOM parser
+        if (main_referee_)
+            referees_.push_back(*main_referee_);
+
+        game_->teams.assign(std::make_move_iterator(teams_.begin()),
+                            std::make_move_iterator(teams_.end()));
+        game_->referees.assign(referees_.begin(), referees_.end());
+        teams_.clear();
+        referees_.clear();
+        main_referee_.reset();
+    }
+
+    void StreamParser::open_referee(const AttributeView &attr)
+    {
+        referees_.emplace_back(attr, *memory_);
+    }
+
+    void StreamParser::open_main_referee(const AttributeView &attr)
+    {
+        if (main_referee_)
+            return;  // only the first one counts
+        main_referee_.emplace(attr, *memory_);
+        main_referee_->set_main(true);
+    }
+
+    void StreamParser::open_team(const AttributeView &attr)
+    {
+        team_.emplace(attr, *memory_);
+        team_has_players_ = false;
+        team_has_starting_players_ = false;
+    }
+
+    void StreamParser::close_team()
+    {
+        if (!team_has_players_) {
+            throw ParseError(
+                "XML is corrupted, there is no Speletaji subnode!");
+        }
+        if (!team_has_starting_players_) {
+            throw ParseError(
+                "XML is corrupted, there is no Pamatsastavs subnode!");
+        }
+
+        team_->players.assign(players_.begin(), players_.end());
+        team_->subsitutions.assign(substitutions_.begin(),
+                                   substitutions_.end());
+        team_->starting_players.assign(starting_players_.begin(),
+                                       starting_players_.end());
+        team_->penalties.assign(penalties_.begin(), penalties_.end());
+        team_->goals.assign(std::make_move_iterator(goals_.begin()),
+                            std::make_move_iterator(goals_.end()));
+        teams_.push_back(std::move(*team_));
+
+        team_.reset();
+        players_.clear();
+        substitutions_.clear();
+        starting_players_.clear();
+        penalties_.clear();
+        goals_.clear();
+    }
+
+    void StreamParser::open_players(const AttributeView &)
+    {
+        team_has_players_ = true;
+    }
+
+    void StreamParser::open_player(const AttributeView &attr)
+    {
+        players_.emplace_back(attr, *memory_);
+    }
+
+    void StreamParser::open_substitution(const AttributeView &attr)
+    {
+        substitutions_.emplace_back(attr);
+    }
+
+    void StreamParser::open_starting_players(const AttributeView &)
+    {
+        team_has_starting_players_ = true;
+    }
+
+    void StreamParser::open_starting_player(const AttributeView &attr)
+    {
+        starting_players_.push_back(parse_int(attr.at("Nr")));
+    }
+
+    void StreamParser::open_penalty(const AttributeView &attr)
+    {
+        penalties_.emplace_back(attr);
+    }
+
+    void StreamParser::open_goal(const AttributeView &attr)
+    {
+        goal_.emplace(attr, *memory_);
+    }
+
+    void StreamParser::close_goal()
+    {
+        goal_->assists.assign(assists_.begin(), assists_.end());
+        goals_.push_back(std::move(*goal_));
+        goal_.reset();
+        assists_.clear();
+    }
+
+    void StreamParser::open_assist(const AttributeView &attr)
+    {
+        assists_.push_back(parse_int(attr.at("Nr")));
+    }
+}  // namespace LFL::XMLParser
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "Arena.h"
+#include "Parser.h"
+
+namespace LFL::XMLParser {
+
+    /// Single pass parser of game protocols. Elements are recognized by the
+    /// schema (element name in its parent), as soon as start tag is read
+    /// from the text, and LFL::Data objects are built right away, there is
+    /// no intermediate XML tree. Unknown elements are skipped together with
+    /// everything inside.
+    /// Scratch buffers are kept between files, so in steady state parsing
+    /// does not allocate, except for the parsed game itself.
+    /// Not thread-safe, use one parser per thread.
+    class StreamParser {
+    public:
+        StreamParser() = default;
+        StreamParser(const StreamParser &) = delete;
+        StreamParser &operator=(const StreamParser &) = delete;
+
+        /// Parses zero terminated protocol. Attribute values are decoded in
+        /// place, so text is modified.
+        /// \throws ParseError if text is not well formed XML or has no Spele
+        /// element
+        Data::Game parse(char *text, const GameMemory &memory);
+
+    private:
+        /// Where elements can occur, and what is built from them
+        enum class Scope {
+            DOCUMENT,
+            GAME,
+            TEAM,
+            PLAYERS,
+            SUBSTITUTIONS,
+            STARTING_PLAYERS,
+            PENALTIES,
+            GOALS,
+            GOAL,
+            /// Element without known children
+            LEAF,
+            /// Unknown element, whole subtree is skipped
+            SKIPPED
+        };
+
+        /// Element of the schema
+        struct Rule {
+            Scope parent;
+            std::string_view element;
+            Scope scope;
+            /// Called with attributes of start tag, may be nullptr
+            void (StreamParser::*open)(const AttributeView &attr);
+            /// Called at end tag (or at the end of empty element), may be
+            /// nullptr
+            void (StreamParser::*close)();
+        };
+
+        struct OpenElement {
+            std::string_view name;
+            Scope scope;
+            const Rule *rule;
+        };
+
+        static const Rule *find_rule(Scope parent, std::string_view element);
+
+        void parse_document(char *text);
+        void start_element(std::string_view name,
+                           const Rule *rule,
+                           bool empty);
+        void end_element(std::string_view name);
+        void reset();
+
+        void open_game(const AttributeView &attr);
+        void close_game();
+        void open_referee(const AttributeView &attr);
+        void open_main_referee(const AttributeView &attr);
+        void open_team(const AttributeView &attr);
+        void close_team();
+        void open_players(const AttributeView &attr);
+        void open_player(const AttributeView &attr);
+        void open_substitution(const AttributeView &attr);
+        void open_starting_players(const AttributeView &attr);
+        void open_starting_player(const AttributeView &attr);
+        void open_penalty(const AttributeView &attr);
+        void open_goal(const AttributeView &attr);
+        void close_goal();
+        void open_assist(const AttributeView &attr);
+
+        static const Rule SCHEMA[];
+
+        const GameMemory *memory_ = nullptr;
+        std::vector<OpenElement> stack_;
+        std::vector<Attribute> attributes_;
+
+        std::optional<Data::Game> game_;
+        std::vector<Data::Team> teams_;
+        std::vector<Data::Referee> referees_;
+        std::optional<Data::Referee> main_referee_;
+
+        // Children of currently open team and goal, copied to exactly sized
+        // game containers once it is closed
+        std::optional<Data::Team> team_;
+        bool team_has_players_ = false;
+        bool team_has_starting_players_ = false;
+        std::vector<Data::Player> players_;
+        std::vector<Data::Substitution> substitutions_;
+        std::vector<int> starting_players_;
+        std::vector<Data::Penalty> penalties_;
+        std::vector<Data::Goal> goals_;
+        std::optional<Data::Goal> goal_;
+        std::vector<int> assists_;
+    };
+}  // namespace LFL::XMLParser
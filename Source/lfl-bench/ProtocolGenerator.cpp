@@ -0,0 +1,181 @@
+#include "ProtocolGenerator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace LFL::Bench {
+
+    static const int MAIN_TIME = 60 * 60;
+    static const size_t STARTING_PLAYERS = 11;
+
+    static std::string format_time(int seconds)
+    {
+        char buffer[16];
+        std::snprintf(
+            buffer, sizeof(buffer), "%d:%02d", seconds / 60, seconds % 60);
+        return buffer;
+    }
+
+    ProtocolGenerator::ProtocolGenerator(const ProtocolShape &shape,
+                                         size_t teams,
+                                         unsigned seed)
+        : shape_(shape)
+        , teams_(teams)
+        , rng_(seed)
+    {
+        if (teams_ < 2)
+            throw std::invalid_argument("at least 2 teams are required");
+        if (shape_.players < 2)
+            throw std::invalid_argument("at least 2 players are required");
+    }
+
+    int ProtocolGenerator::random(int from, int to)
+    {
+        return std::uniform_int_distribution<int>(from, to)(rng_);
+    }
+
+    std::string ProtocolGenerator::team_xml(const std::string &name,
+                                            const std::vector<int> &goal_times)
+    {
+        static const char *const NAMES[] = {
+            "Janis", "Peteris", "Anna", "Liga", "Karlis", "Ilze"};
+
+        const int players = static_cast<int>(shape_.players);
+        const int starting =
+            static_cast<int>(std::min(shape_.players, STARTING_PLAYERS));
+
+        std::string xml = "<Komanda Nosaukums=\"" + name + "\">\n";
+
+        xml += "<Speletaji>\n";
+        for (int nr = 1; nr <= players; nr++) {
+            // Number 1 is goalkeeper
+            const char *role = nr == 1 ? "V" : (random(0, 1) ? "U" : "A");
+            xml += "<Speletajs Vards=\"" +
+                   std::string(NAMES[nr % std::size(NAMES)]) +
+                   "\" Uzvards=\"" + name + "_" + std::to_string(nr) +
+                   "\" Loma=\"" + role + "\" Nr=\"" + std::to_string(nr) +
+                   "\"/>\n";
+        }
+        xml += "</Speletaji>\n";
+
+        xml += "<Pamatsastavs>\n";
+        std::vector<int> on_field, on_bench;
+        for (int nr = 1; nr <= players; nr++) {
+            if (nr <= starting) {
+                xml += "<Speletajs Nr=\"" + std::to_string(nr) + "\"/>\n";
+                if (nr != 1)
+                    on_field.push_back(nr);
+            }
+            else {
+                on_bench.push_back(nr);
+            }
+        }
+        xml += "</Pamatsastavs>\n";
+
+        // Field players are replaced by any player from the bench,
+        // goalkeeper plays whole game
+        xml += "<Mainas>\n";
+        int time = 0;
+        for (size_t i = 0; i < shape_.substitutions; i++) {
+            time += random(1, MAIN_TIME / int(shape_.substitutions + 1));
+            if (time >= MAIN_TIME or on_field.empty() or on_bench.empty())
+                break;
+
+            auto out = on_field.begin() + random(0, int(on_field.size()) - 1);
+            auto in = on_bench.begin() + random(0, int(on_bench.size()) - 1);
+            xml += "<Maina Laiks=\"" + format_time(time) + "\" Nr1=\"" +
+                   std::to_string(*out) + "\" Nr2=\"" + std::to_string(*in) +
+                   "\"/>\n";
+            std::swap(*out, *in);
+        }
+        xml += "</Mainas>\n";
+
+        xml += "<Sodi>\n";
+        for (size_t i = 0; i < shape_.penalties; i++) {
+            xml += "<Sods Laiks=\"" + format_time(random(1, MAIN_TIME - 1)) +
+                   "\" Nr=\"" + std::to_string(random(1, players)) + "\"/>\n";
+        }
+        xml += "</Sodi>\n";
+
+        xml += "<Varti>\n";
+        for (int goal_time : goal_times) {
+            xml += "<VG Laiks=\"" + format_time(goal_time) + "\" Nr=\"" +
+                   std::to_string(random(2, players)) + "\" Sitiens=\"" +
+                   (random(0, 3) ? "J" : "N") + "\">";
+            for (int a = random(0, 2); a > 0; a--) {
+                xml += "<P Nr=\"" + std::to_string(random(2, players)) +
+                       "\"/>";
+            }
+            xml += "</VG>\n";
+        }
+        xml += "</Varti>\n";
+
+        xml += "</Komanda>\n";
+        return xml;
+    }
+
+    std::string ProtocolGenerator::next_game()
+    {
+        const size_t game = games_++;
+
+        const int first = random(0, int(teams_) - 1);
+        const int second = (first + random(1, int(teams_) - 1)) % int(teams_);
+
+        std::vector<int> goals[2];
+        for (auto &times : goals) {
+            for (int i = random(0, int(shape_.goals)); i > 0; i--) {
+                times.push_back(random(1, MAIN_TIME - 1));
+            }
+            std::sort(times.begin(), times.end());
+        }
+        // Draw is decided in overtime
+        if (goals[0].size() == goals[1].size())
+            goals[random(0, 1)].push_back(MAIN_TIME + random(1, 300));
+
+        // Unique date for every game: 12 months of 28 days in a year
+        char date[32];
+        std::snprintf(date,
+                      sizeof(date),
+                      "%zu/%02zu/%02zu",
+                      2000 + game / 336,
+                      game % 336 / 28 + 1,
+                      game % 28 + 1);
+
+        std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        xml += "<Spele Laiks=\"" + std::string(date) + "\" Skatitaji=\"" +
+               std::to_string(random(100, 10000)) + "\" Vieta=\"Riga\">\n";
+        xml += "<T Vards=\"Referee\" Uzvards=\"One\"/>\n";
+        xml += "<T Vards=\"Referee\" Uzvards=\"Two\"/>\n";
+        xml += "<VT Vards=\"Main\" Uzvards=\"Referee\"/>\n";
+        xml += team_xml("Team" + std::to_string(first), goals[0]);
+        xml += team_xml("Team" + std::to_string(second), goals[1]);
+        xml += "</Spele>\n";
+        return xml;
+    }
+
+    size_t write_protocols(ProtocolGenerator &generator,
+                           const std::string &directory,
+                           size_t games)
+    {
+        std::filesystem::create_directories(directory);
+
+        size_t bytes = 0;
+        for (size_t i = 0; i < games; i++) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "game%05zu.xml", i);
+
+            const std::string xml = generator.next_game();
+            std::ofstream file(std::filesystem::path(directory) / name,
+                               std::ios::binary);
+            file << xml;
+            if (!file)
+                throw std::runtime_error("cannot write protocol to '" +
+                                         directory + "'");
+            bytes += xml.size();
+        }
+        return bytes;
+    }
+}  // namespace LFL::Bench
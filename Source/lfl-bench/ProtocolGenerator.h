@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace LFL::Bench {
+
+    /// Size of synthetic game protocol, per team
+    struct ProtocolShape {
+        /// Roster size, first 11 (or all, if less) start the game
+        size_t players = 16;
+        size_t substitutions = 4;
+        /// Maximal goals of a team, actual count is random up to it
+        size_t goals = 5;
+        size_t penalties = 2;
+    };
+
+    /// Generates random, but valid "Spele" protocols, in the same format as
+    /// real league protocols. Generated sequence depends only on the seed.
+    class ProtocolGenerator {
+    public:
+        /// \param teams number of teams in the league, at least 2
+        ProtocolGenerator(const ProtocolShape &shape,
+                          size_t teams,
+                          unsigned seed);
+
+        /// \returns XML of next game, each game has unique date, so none
+        /// of them is treated as already processed.
+        std::string next_game();
+
+    private:
+        std::string team_xml(const std::string &name,
+                             const std::vector<int> &goal_times);
+        int random(int from, int to);
+
+        ProtocolShape shape_;
+        size_t teams_;
+        size_t games_ = 0;
+        std::mt19937 rng_;
+    };
+
+    /// Writes protocols to files game00000.xml, game00001.xml, ...
+    /// \returns total size of written files in bytes
+    size_t write_protocols(ProtocolGenerator &generator,
+                           const std::string &directory,
+                           size_t games);
+}  // namespace LFL::Bench
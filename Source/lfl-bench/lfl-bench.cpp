@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Database/Models.h"
+#include "ProtocolGenerator.h"
+#include "Utils/Hash.h"
+#include "XMLParser/Arena.h"
+#include "XMLParser/GameCache.h"
+#include "XMLParser/Parser.h"
+#include "XMLParser/StreamParser.h"
+
+namespace {
+
+    struct Config {
+        LFL::Bench::ProtocolShape shape;
+        size_t games = 200;
+        size_t teams = 8;
+        size_t iterations = 5;
+        size_t truncate_after = 0;
+        unsigned seed = 1;
+        std::string output;
+    };
+
+    /// Timings of one benchmark
+    struct Result {
+        std::string name;
+        /// Processed per iteration
+        size_t items = 0;
+        size_t bytes = 0;
+        std::vector<double> ms;
+    };
+
+    /// Swallows everything, used to silence progress output of measured
+    /// code
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+    };
+
+    /// Runs body \p iterations times, only body itself is measured
+    Result measure(const std::string &name,
+                   size_t iterations,
+                   const std::function<void()> &setup,
+                   const std::function<void()> &body)
+    {
+        Result res;
+        res.name = name;
+        for (size_t i = 0; i < iterations; i++) {
+            if (setup)
+                setup();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double, std::milli> took =
+                std::chrono::steady_clock::now() - start;
+            res.ms.push_back(took.count());
+        }
+        return res;
+    }
+
+    void write_json(std::ostream &os,
+                    const Config &config,
+                    const std::vector<Result> &results)
+    {
+        os << "{\n";
+        os << "  \"config\": {\"games\": " << config.games
+           << ", \"teams\": " << config.teams
+           << ", \"players\": " << config.shape.players
+           << ", \"substitutions\": " << config.shape.substitutions
+           << ", \"goals\": " << config.shape.goals
+           << ", \"penalties\": " << config.shape.penalties
+           << ", \"iterations\": " << config.iterations
+           << ", \"max_player\": " << config.truncate_after
+           << ", \"seed\": " << config.seed << "},\n";
+        os << "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto &r = results[i];
+
+            auto sorted = r.ms;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0;
+            for (double ms : sorted) {
+                sum += ms;
+            }
+            const double min = sorted.front();
+            const double median = sorted[sorted.size() / 2];
+            const double mean = sum / sorted.size();
+
+            os << "    {\"name\": \"" << r.name << "\""
+               << ", \"iterations\": " << r.ms.size()
+               << ", \"items\": " << r.items << ", \"bytes\": " << r.bytes
+               << ", \"min_ms\": " << min << ", \"median_ms\": " << median
+               << ", \"mean_ms\": " << mean
+               << ", \"items_per_second\": " << r.items / min * 1000;
+            if (r.bytes != 0)
+                os << ", \"mb_per_second\": " << r.bytes / min / 1000;
+            os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "  ]\n";
+        os << "}\n";
+    }
+
+    void help()
+    {
+        std::cout << "Usage: lfl-bench [options]\n";
+        std::cout << "Options:\n";
+
+        std::vector<std::pair<std::string, std::string>> options = {
+            std::make_pair("--help", "Display this information."),
+            std::make_pair("--games <N>", "Generated games (default 200)."),
+            std::make_pair("--teams <N>", "Teams in the league (default 8)."),
+            std::make_pair("--players <N>", "Players per team (default 16)."),
+            std::make_pair("--substitutions <N>",
+                           "Substitutions per team (default 4)."),
+            std::make_pair("--goals <N>",
+                           "Maximal goals per team (default 5)."),
+            std::make_pair("--penalties <N>",
+                           "Penalties per team (default 2)."),
+            std::make_pair("--iterations <N>",
+                           "Runs of every benchmark (default 5)."),
+            std::make_pair("--max-player <N>",
+                           "Truncate generated tables after N-th player."),
+            std::make_pair("--seed <N>", "Generator seed (default 1)."),
+            std::make_pair("--output <file>",
+                           "Write JSON results to file instead of stdout."),
+        };
+
+        for (auto &o : options) {
+            while (o.first.size() < 24)
+                o.first += ' ';
+            std::cout << "\t" << o.first << o.second << "\n";
+        }
+    }
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+
+    Config config;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == "--help") {
+            help();
+            return 0;
+        }
+
+        // All other options expect next token
+        if (i + 1 >= args.size()) {
+            std::cout << "One more token expected!" << std::endl;
+            std::cout << "Run --help to list all options!" << std::endl;
+            return 1;
+        }
+
+        const std::string &next_token = args[i + 1];
+
+        if (args[i] == "--games") {
+            config.games = std::stoul(next_token);
+        }
+        else if (args[i] == "--teams") {
+            config.teams = std::stoul(next_token);
+        }
+        else if (args[i] == "--players") {
+            config.shape.players = std::stoul(next_token);
+        }
+        else if (args[i] == "--substitutions") {
+            config.shape.substitutions = std::stoul(next_token);
+        }
+        else if (args[i] == "--goals") {
+            config.shape.goals = std::stoul(next_token);
+        }
+        else if (args[i] == "--penalties") {
+            config.shape.penalties = std::stoul(next_token);
+        }
+        else if (args[i] == "--iterations") {
+            config.iterations = std::max<size_t>(1, std::stoul(next_token));
+        }
+        else if (args[i] == "--max-player") {
+            config.truncate_after = std::stoul(next_token);
+        }
+        else if (args[i] == "--seed") {
+            config.seed = static_cast<unsigned>(std::stoul(next_token));
+        }
+        else if (args[i] == "--output") {
+            config.output = next_token;
+        }
+        else {
+            std::cout << "Unknown option '" << args[i] << "';" << std::endl;
+            std::cout << "Run --help to list all options!" << std::endl;
+            return 1;
+        }
+
+        i++;  // all options expect one more token
+    }
+
+    const auto work_dir =
+        std::filesystem::temp_directory_path() /
+        ("lfl-bench-" + std::to_string(std::random_device()()));
+    const auto protocols_dir = (work_dir / "protocols").string();
+    const auto report_file = (work_dir / "report.html").string();
+
+    LFL::Bench::ProtocolGenerator generator(
+        config.shape, config.teams, config.seed);
+    const size_t bytes =
+        LFL::Bench::write_protocols(generator, protocols_dir, config.games);
+
+    std::vector<std::string> files;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(protocols_dir)) {
+        files.push_back(entry.path().string());
+    }
+    std::sort(files.begin(), files.end());
+
+    // Measured code reports progress, keep stdout for results only
+    NullBuffer null_buffer;
+    std::streambuf *stdout_buffer = std::cout.rdbuf(&null_buffer);
+
+    std::vector<Result> results;
+
+    // XML parsing, the way ingest does it, and through rapidxml document
+    using LFL::XMLParser::Frontend;
+    for (auto [name, frontend] :
+         {std::make_pair("parse_game_file", Frontend::STREAMING),
+          std::make_pair("parse_game_file_dom", Frontend::DOM)}) {
+        LFL::XMLParser::ParserContext parser(frontend);
+        LFL::XMLParser::GameArena arena;
+        auto res = measure(name, config.iterations, nullptr, [&] {
+            for (const auto &file : files) {
+                parser.parse_game_file(file, arena.memory());
+                arena.reset();
+            }
+        });
+        res.items = files.size();
+        res.bytes = bytes;
+        results.push_back(std::move(res));
+    }
+
+    {  // The same games read back from binary cache (lfl --cache on), as
+       // on later runs: protocols did not change, and were copied (only
+       // modification time differs, so XML is hashed)
+        using LFL::XMLParser::CacheSource;
+        using LFL::XMLParser::GameCache;
+        LFL::XMLParser::ParserContext parser;
+        LFL::XMLParser::InputFile input;
+        GameCache cache;
+        LFL::XMLParser::GameArena arena;
+        std::vector<CacheSource> sources;
+        for (const auto &file : files) {
+            const char *text = input.open(file);
+            const CacheSource source{
+                static_cast<int64_t>(input.size()),
+                static_cast<int64_t>(std::filesystem::last_write_time(file)
+                                         .time_since_epoch()
+                                         .count()),
+                LFL::Utils::hash64(text, input.size())};
+            input.close();
+            cache.write(GameCache::path_of(file),
+                        parser.parse_game_file(file, arena.memory()),
+                        source);
+            sources.push_back(source);
+            arena.reset();
+        }
+
+        for (auto [name, touched] :
+             {std::make_pair("read_game_cache", false),
+              std::make_pair("read_game_cache_touched", true)}) {
+            auto res = measure(name, config.iterations, nullptr, [&] {
+                for (size_t i = 0; i < files.size(); i++) {
+                    CacheSource source = sources[i];
+                    source.hash = 0;
+                    source.mtime += touched ? 1 : 0;
+                    cache.read(
+                        GameCache::path_of(files[i]),
+                        source,
+                        [&] {
+                            const char *text = input.open(files[i]);
+                            const uint64_t hash =
+                                LFL::Utils::hash64(text, input.size());
+                            input.close();
+                            return hash;
+                        },
+                        arena.memory());
+                    arena.reset();
+                }
+            });
+            res.items = files.size();
+            res.bytes = bytes;
+            results.push_back(std::move(res));
+        }
+    }
+
+    {  // Parsing of files already in memory: rapidxml document alone and
+       // whole games with stream parser
+        std::vector<std::string> texts;
+        for (const auto &file : files) {
+            std::ifstream ifs(file, std::ios::binary);
+            texts.emplace_back(std::istreambuf_iterator<char>(ifs),
+                               std::istreambuf_iterator<char>());
+        }
+        // Both parsers modify text in place
+        std::vector<std::string> work;
+        auto copy_texts = [&] { work = texts; };
+
+        rapidxml::xml_document<> doc;
+        auto res = measure("parse_memory_rapidxml",
+                           config.iterations,
+                           copy_texts,
+                           [&] {
+                               for (auto &text : work) {
+                                   doc.clear();
+                                   doc.parse<0>(text.data());
+                               }
+                           });
+        res.items = files.size();
+        res.bytes = bytes;
+        results.push_back(std::move(res));
+
+        LFL::XMLParser::StreamParser parser;
+        LFL::XMLParser::GameArena arena;
+        res = measure("parse_memory_stream",
+                      config.iterations,
+                      copy_texts,
+                      [&] {
+                          for (auto &text : work) {
+                              parser.parse(text.data(), arena.memory());
+                              arena.reset();
+                          }
+                      });
+        res.items = files.size();
+        res.bytes = bytes;
+        results.push_back(std::move(res));
+    }
+
+    // Statistics and report are measured on already parsed games
+    std::vector<LFL::XMLParser::Data::Game> games;
+    for (const auto &file : files) {
+        games.push_back(LFL::XMLParser::parse_game_file(file));
+    }
+
+    {  // Statistics into empty in memory database
+        std::unique_ptr<LFL::Database::Session> session;
+        auto res = measure(
+            "process_game_info",
+            config.iterations,
+            [&] {
+                session = std::make_unique<LFL::Database::Session>(":memory:");
+            },
+            [&] {
+                for (const auto &game : games) {
+                    LFL::Database::process_game_info(*session, game);
+                }
+                session->flush();
+            });
+        res.items = games.size();
+        results.push_back(std::move(res));
+    }
+
+    {  // Report of the whole league
+        LFL::Database::Session session(":memory:");
+        for (const auto &game : games) {
+            LFL::Database::process_game_info(session, game);
+        }
+        session.flush();
+
+        // Without cached sections, as after every ingest
+        auto res = measure(
+            "generate_html_output",
+            config.iterations,
+            [&] {
+                session.storage.remove_all<LFL::Database::MReportFragment>();
+            },
+            [&] {
+                LFL::Database::generate_html_output(
+                    session, report_file, config.truncate_after);
+            });
+        res.items = games.size();
+        results.push_back(std::move(res));
+
+        // All sections cached, as when nothing changed
+        res = measure("generate_html_output_cached",
+                      config.iterations,
+                      nullptr,
+                      [&] {
+                          LFL::Database::generate_html_output(
+                              session, report_file, config.truncate_after);
+                      });
+        res.items = games.size();
+        results.push_back(std::move(res));
+    }
+
+    std::cout.rdbuf(stdout_buffer);
+    std::filesystem::remove_all(work_dir);
+
+    if (config.output.empty()) {
+        write_json(std::cout, config, results);
+    }
+    else {
+        std::ofstream ofs(config.output);
+        write_json(ofs, config, results);
+    }
+
+    return 0;
+}
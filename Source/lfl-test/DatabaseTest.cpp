@@ -0,0 +1,737 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "Database/HtmlWriter.h"
+#include "Database/League.h"
+#include "Database/Manifest.h"
+#include "DatabaseTest.h"
+
+using LFL::Database::FileManifest;
+using LFL::Database::HtmlWriter;
+using LFL::Database::IngestBatch;
+using LFL::Database::MIngestedFile;
+using LFL::Database::MMatchHistory;
+using LFL::Database::MPlayer;
+using LFL::Database::MReportFragment;
+using LFL::Database::MTeam;
+using LFL::Database::PlayerRanking;
+using LFL::Database::Session;
+using LFL::XMLParser::Data::Game;
+using LFL::XMLParser::Data::Goal;
+using LFL::XMLParser::Data::PlayerType;
+using LFL::XMLParser::Data::Team;
+
+/// \returns game of teams "A" and "B" with two players each, "A" scores
+/// once. If extra_number is given, it is added to the roster of "B".
+static Game make_game(std::string_view date, int extra_number = -1)
+{
+    const LFL::XMLParser::GameMemory memory;
+    Game game(date, "Riga", 100, memory);
+    for (std::string_view name : {"A", "B"}) {
+        auto &team = game.teams.emplace_back(name, memory);
+        team.players.emplace_back("Ann", name, PlayerType::GOALKEEPER, 1);
+        team.players.emplace_back("Bob", name, PlayerType::ATTACKER, 7);
+        team.starting_players = {1, 7};
+    }
+    game.teams[0].goals.emplace_back(600, 7, true, memory);
+    if (extra_number >= 0) {
+        game.teams[1].players.emplace_back(
+            "Eve", "B", PlayerType::ATTACKER, extra_number);
+    }
+    return game;
+}
+
+static MIngestedFile make_file(const std::string &path)
+{
+    return MIngestedFile{path, 1, 1, 1};
+}
+
+void TEST_INGEST_BATCH()
+{
+    Session session(":memory:");
+    {
+        IngestBatch batch(session, 1);
+        batch.add(make_game("2022/01/01"), make_file("/1.xml"));
+    }
+    {
+        // Destroyed before commit, as if the next file was malformed
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/02"), make_file("/2.xml"));
+    }
+    {
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/03"), make_file("/3.xml"));
+        batch.commit();
+    }
+
+    auto &storage = session.storage;
+    const auto teams = storage.get_all<MTeam>();
+    if (teams.size() != 2 or teams[0].games != 2 or teams[1].games != 2 or
+        teams[0].goals_for != 2 or teams[1].goals_again != 2) {
+        std::cerr << "Test: Database::IngestBatch: Team stats of "
+                     "uncommitted game were committed\n";
+    }
+    if (storage.count<MMatchHistory>() != 4) {
+        std::cerr << "Test: Database::IngestBatch: History of uncommitted "
+                     "game was committed\n";
+    }
+    if (storage.count<MIngestedFile>() != 2 or
+        storage.get_pointer<MIngestedFile>(std::string("/2.xml"))) {
+        std::cerr << "Test: Database::IngestBatch: File of uncommitted game "
+                     "was committed\n";
+    }
+}
+
+void TEST_PLAYER_NUMBERS()
+{
+    using LFL::XMLParser::Data::Penalty;
+    using LFL::XMLParser::Data::Substitution;
+
+    // Number 1000 is out of range, 42 is not in the roster. Events of both
+    // are ignored, the rest of the game is recorded.
+    const LFL::XMLParser::GameMemory memory;
+    auto game = make_game("2022/01/01", 1000);
+    auto &team = game.teams[1];
+    team.goals.emplace_back(300, 1000, true, memory).assists = {42, 7};
+    team.goals.emplace_back(400, 42, false, memory);
+    team.penalties.emplace_back(100, 1000);
+    team.penalties.emplace_back(200, 42);
+    team.subsitutions.emplace_back(1800, 7, 1000);
+
+    Session session(":memory:");
+    {
+        IngestBatch batch(session, 0);
+        batch.add(game, make_file("/1.xml"));
+        batch.commit();
+    }
+
+    auto &storage = session.storage;
+    const auto players = storage.get_all<MPlayer>();
+    if (players.size() != 4) {
+        std::cerr << "Test: Database::LeagueState: Player with out of range "
+                     "number was recorded\n";
+    }
+    for (const auto &p : players) {
+        if (p.team_id != 2)
+            continue;
+        const bool b_attacker = p.number == 7;
+        if (p.yellow_cards != 0 or p.goals != 0 or p.goal_from_penalty != 0 or
+            p.assists != (b_attacker ? 1 : 0)) {
+            std::cerr << "Test: Database::LeagueState: Event of unknown "
+                         "player was recorded\n";
+        }
+        if (b_attacker and p.seconds_on_field != 1800) {
+            std::cerr << "Test: Database::LeagueState: Substitution to out of "
+                         "range number was not applied\n";
+        }
+    }
+    const auto teams = storage.get_all<MTeam>();
+    if (teams.size() != 2 or teams[1].goals_for != 2) {
+        std::cerr << "Test: Database::LeagueState: Goals of unknown players "
+                     "were not counted for the team\n";
+    }
+}
+
+/// \returns count of cached sections in the report, see mark_fragments
+static size_t count_marked_sections(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    const std::string html((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    const std::string marker = "<!-- cached -->";
+    size_t count = 0;
+    for (auto pos = html.find(marker); pos != std::string::npos;
+         pos = html.find(marker, pos + marker.size())) {
+        count++;
+    }
+    return count;
+}
+
+/// Replaces HTML of every cached section with a marker
+static void mark_fragments(Session &session)
+{
+    auto fragments = session.storage.get_all<MReportFragment>();
+    for (auto &fragment : fragments) {
+        fragment.html = "<!-- cached -->";
+    }
+    session.storage.replace_range(fragments.begin(), fragments.end());
+}
+
+void TEST_REPORT_FRAGMENTS()
+{
+    using LFL::Database::generate_html_output;
+    using LFL::Database::table_generation;
+
+    const auto path =
+        (std::filesystem::temp_directory_path() / "lfl-test-report.html")
+            .string();
+    Session session(":memory:");
+    auto &storage = session.storage;
+    {
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/01"), make_file("/1.xml"));
+        batch.commit();
+    }
+    generate_html_output(session, path, 0);
+
+    // Nothing changed, every section is taken from the cache
+    mark_fragments(session);
+    generate_html_output(session, path, 0);
+    if (count_marked_sections(path) != 6) {
+        std::cerr << "Test: Database::generate_html_output: Unchanged "
+                     "sections were rendered again\n";
+    }
+
+    // Nobody played and scored, only teams are changed
+    const int players_generation = table_generation(storage, "players");
+    const int teams_generation = table_generation(storage, "teams");
+    {
+        auto game = make_game("2022/01/02");
+        for (auto &team : game.teams) {
+            team.starting_players.clear();
+            team.goals.clear();
+        }
+        IngestBatch batch(session, 0);
+        batch.add(game, make_file("/2.xml"));
+        batch.commit();
+    }
+    if (table_generation(storage, "players") != players_generation or
+        table_generation(storage, "teams") != teams_generation + 1) {
+        std::cerr << "Test: Database::LeagueState: Players generation was "
+                     "bumped without changed players\n";
+    }
+
+    // Played game changes players, their sections are rendered again
+    generate_html_output(session, path, 0);
+    mark_fragments(session);
+    {
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/03"), make_file("/3.xml"));
+        batch.commit();
+    }
+    if (table_generation(storage, "players") != players_generation + 1) {
+        std::cerr << "Test: Database::LeagueState: Players generation was "
+                     "not bumped\n";
+    }
+    generate_html_output(session, path, 0);
+    if (count_marked_sections(path) != 0) {
+        std::cerr << "Test: Database::generate_html_output: Changed sections "
+                     "were taken from the cache\n";
+    }
+    std::filesystem::remove(path);
+
+    // Every write to this device fails, report must not look written
+    if (std::filesystem::exists("/dev/full")) {
+        bool thrown = false;
+        try {
+            generate_html_output(session, "/dev/full", 0);
+        }
+        catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        if (!thrown) {
+            std::cerr << "Test: Database::generate_html_output: Failed write "
+                         "did not throw\n";
+        }
+    }
+}
+
+void TEST_HISTORY_MIGRATION()
+{
+    const auto path =
+        (std::filesystem::temp_directory_path() / "lfl-test-history.sqlite")
+            .string();
+    std::filesystem::remove(path);
+
+    // History as written before it became unique, second team of the
+    // game on 2022/01/01 is recorded twice
+    sqlite3 *db = nullptr;
+    sqlite3_open(path.c_str(), &db);
+    sqlite3_exec(db,
+                 "CREATE TABLE 'history' ('id' INTEGER PRIMARY KEY NOT NULL, "
+                 "'team_id' INTEGER NOT NULL, 'date' TEXT NOT NULL);"
+                 "INSERT INTO history VALUES (1, 1, '2022/01/01'),"
+                 "(2, 2, '2022/01/01'), (3, 2, '2022/01/01'),"
+                 "(4, 1, '2022/01/02');",
+                 nullptr,
+                 nullptr,
+                 nullptr);
+    sqlite3_close(db);
+
+    try {
+        Session session(path);
+        const auto ids = session.storage.select(
+            &MMatchHistory::id, sqlite_orm::order_by(&MMatchHistory::id));
+        if (ids != std::vector<int>{1, 2, 4}) {
+            std::cerr << "Test: Database::Session: Duplicate history rows "
+                         "were not removed\n";
+        }
+    }
+    catch (const std::system_error &e) {
+        std::cerr << "Test: Database::Session: Database with duplicate "
+                     "history rows can not be opened: "
+                  << e.what() << "\n";
+    }
+
+    std::filesystem::remove(path);
+}
+
+/// \returns players of the team as one string, with ids
+static std::string dump_players(Session &session, int team_id)
+{
+    using namespace sqlite_orm;
+
+    std::string res;
+    for (const auto &p : session.storage.get_all<MPlayer>(
+             where(is_equal(&MPlayer::team_id, team_id)))) {
+        for (int value : {p.id,
+                          p.number,
+                          p.games,
+                          p.seconds_on_field,
+                          p.yellow_cards,
+                          p.red_cards,
+                          p.goals,
+                          p.assists,
+                          p.goal_from_penalty,
+                          p.goalkeper_got_scores}) {
+            res += std::to_string(value) + ' ';
+        }
+        res += p.name + ' ' + p.surname + '\n';
+    }
+    return res;
+}
+
+void TEST_CHANGED_PLAYERS_FLUSH()
+{
+    const auto path =
+        (std::filesystem::temp_directory_path() / "lfl-test-flush.sqlite")
+            .string();
+    std::filesystem::remove(path);
+
+    // Teams A, B (ids 1, 2) and C, D (ids 3, 4) play once
+    std::string other_players;
+    {
+        Session session(path);
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/01"));
+        auto game = make_game("2022/01/01");
+        game.teams[0].name = "C";
+        game.teams[1].name = "D";
+        batch.add(game);
+        batch.commit();
+        other_players = dump_players(session, 3) + dump_players(session, 4);
+    }
+
+    // Every following write of teams and players rows is logged
+    sqlite3 *db = nullptr;
+    sqlite3_open(path.c_str(), &db);
+    sqlite3_exec(db,
+                 "CREATE TABLE written (tbl TEXT, id INTEGER);"
+                 "CREATE TRIGGER players_update AFTER UPDATE ON players "
+                 "BEGIN INSERT INTO written VALUES ('players', NEW.team_id); "
+                 "END;"
+                 "CREATE TRIGGER players_insert AFTER INSERT ON players "
+                 "BEGIN INSERT INTO written VALUES ('players', NEW.team_id); "
+                 "END;"
+                 "CREATE TRIGGER teams_update AFTER UPDATE ON teams "
+                 "BEGIN INSERT INTO written VALUES ('teams', NEW.id); END;"
+                 "CREATE TRIGGER teams_insert AFTER INSERT ON teams "
+                 "BEGIN INSERT INTO written VALUES ('teams', NEW.id); END;",
+                 nullptr,
+                 nullptr,
+                 nullptr);
+    sqlite3_close(db);
+
+    // Only A and B play again
+    {
+        Session session(path);
+        IngestBatch batch(session, 0);
+        batch.add(make_game("2022/01/02"));
+        batch.commit();
+        if (dump_players(session, 3) + dump_players(session, 4) !=
+            other_players) {
+            std::cerr << "Test: Database::LeagueState: Players of teams out "
+                         "of the game were changed\n";
+        }
+    }
+
+    sqlite3_open(path.c_str(), &db);
+    sqlite3_stmt *stmt = nullptr;
+    sqlite3_prepare_v2(db,
+                       "SELECT tbl, count(*) FROM written WHERE id > 2 "
+                       "GROUP BY tbl",
+                       -1,
+                       &stmt,
+                       nullptr);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        std::cerr << "Test: Database::LeagueState: "
+                  << sqlite3_column_int(stmt, 1) << " row(s) of "
+                  << sqlite3_column_text(stmt, 0)
+                  << " out of the game were written\n";
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_prepare_v2(
+        db, "SELECT count(*) FROM written", -1, &stmt, nullptr);
+    if (sqlite3_step(stmt) != SQLITE_ROW or sqlite3_column_int(stmt, 0) == 0) {
+        std::cerr << "Test: Database::LeagueState: Writes of the game were "
+                     "not logged\n";
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+
+    std::filesystem::remove(path);
+}
+
+/// Writes the same row of names and numbers, as report tables do
+static void write_html_fixture(HtmlWriter &out)
+{
+    out.raw("\t<tr>\n");
+    out.raw("\t\t<td>")
+        .text("O'Neil")
+        .raw(" ")
+        .text("\"Sam\"")
+        .raw(" (")
+        .number(16)
+        .raw(")</td>\n");
+    out.cell("A&B <FC>");
+    out.cell(0);
+    out.cell(-42);
+    out.cell(2147483647);
+    out.cell(2.5);
+    out.cell(1.0 / 3);
+    out.cell(1234567.0);
+    out.cell(0.0);
+    out.raw("\t</tr>\n");
+}
+
+void TEST_HTML_WRITER()
+{
+    const std::string expected =
+        "\t<tr>\n"
+        "\t\t<td>O&#39;Neil &quot;Sam&quot; (16)</td>\n"
+        "\t\t<td>A&amp;B &lt;FC&gt;</td>\n"
+        "\t\t<td>0</td>\n"
+        "\t\t<td>-42</td>\n"
+        "\t\t<td>2147483647</td>\n"
+        "\t\t<td>2.5</td>\n"
+        "\t\t<td>0.333333</td>\n"
+        "\t\t<td>1.23457e+06</td>\n"
+        "\t\t<td>0</td>\n"
+        "\t</tr>\n";
+
+    HtmlWriter memory;
+    write_html_fixture(memory);
+    if (memory.str() != expected) {
+        std::cerr << "Test: Database::HtmlWriter: Written HTML does not "
+                     "match expected\n";
+    }
+
+    // Small buffer is flushed to the file many times, some markup is
+    // bigger than the buffer
+    std::FILE *file = std::tmpfile();
+    {
+        HtmlWriter out(file, 8);
+        write_html_fixture(out);
+    }
+    std::string written(expected.size() + 1, '\0');
+    std::rewind(file);
+    written.resize(std::fread(written.data(), 1, written.size(), file));
+    std::fclose(file);
+    if (written != expected) {
+        std::cerr << "Test: Database::HtmlWriter: HTML written to file does "
+                     "not match expected\n";
+    }
+}
+
+/// Seconds on the field and enemy goals during them, computed by nested
+/// loops over players and events, as field time was computed before
+/// LFL::Database::sweep_field_time
+static std::map<int, std::pair<int, int>> reference_field_time(
+    const Team &our_team,
+    const Team &en_team,
+    int match_lenght)
+{
+    std::map<int, std::pair<int, int>> res;
+    for (const auto &player : our_team.players) {
+        const int my_numb = player.number;
+        int play_time = 0;
+        int goals_against = 0;
+        int last_event_time = 0;
+        bool is_playing =
+            std::find(our_team.starting_players.begin(),
+                      our_team.starting_players.end(),
+                      my_numb) != our_team.starting_players.end();
+
+        // Not left half-open interval (L; R]
+        auto got_goals = [&en_team, &goals_against](int L, int R) {
+            for (const auto &goal : en_team.goals) {
+                if (L < goal.time and goal.time <= R)
+                    goals_against += 1;
+            }
+        };
+
+        for (const auto &sub_event : our_team.subsitutions) {
+            if (sub_event.p_out == my_numb) {
+                play_time += sub_event.time - last_event_time;
+                got_goals(last_event_time, sub_event.time);
+                is_playing = false;
+                last_event_time = sub_event.time;
+            }
+            else if (sub_event.p_in == my_numb) {
+                is_playing = true;
+                last_event_time = sub_event.time;
+            }
+        }
+        if (is_playing) {
+            play_time += match_lenght - last_event_time;
+            got_goals(last_event_time, match_lenght);
+        }
+
+        res[my_numb] = {play_time, goals_against};
+    }
+    return res;
+}
+
+void TEST_FIELD_TIME()
+{
+    const LFL::XMLParser::GameMemory memory;
+
+    /// Team of players 1-5, 1-3 start, and given substitutions, against
+    /// team scoring at given times
+    struct Case {
+        const char *name;
+        std::vector<std::array<int, 3>> substitutions;
+        std::vector<int> goal_times;
+        int match_lenght;
+        /// Expected (seconds, goals against) of player 1
+        std::pair<int, int> first;
+    };
+    const Case cases[] = {
+        // Goal at the second of substitution counts for player leaving
+        {"goal at substitution",
+         {{600, 1, 4}},
+         {600, 1200},
+         3600,
+         {600, 1}},
+        {"substitution at 0:00", {{0, 1, 4}}, {0, 30}, 3600, {0, 0}},
+        // Player is substituted by themselves, and stays off
+        {"p_in == p_out", {{900, 1, 1}}, {900, 901}, 3600, {900, 1}},
+        {"re-entry",
+         {{100, 1, 4}, {200, 4, 1}, {300, 1, 5}, {300, 2, 4}},
+         {100, 150, 200, 250, 300, 3000},
+         3600,
+         {200, 3}},
+        {"overtime", {{3500, 3, 5}}, {10, 3700}, 3700, {3700, 2}},
+        // Numbers missing from the roster are ignored
+        {"unknown player", {{500, 2, 99}, {700, 1, 4}}, {}, 3600, {700, 0}},
+    };
+
+    for (const auto &c : cases) {
+        Team our_team("A", memory);
+        Team en_team("B", memory);
+        LFL::Database::TeamPlayers players;
+        for (int number = 1; number <= 5; number++) {
+            our_team.players.emplace_back(
+                "P", "A", PlayerType::ATTACKER, number);
+            LFL::Database::MPlayer player = {};
+            player.id = number;
+            player.number = number;
+            players.insert(player);
+        }
+        our_team.starting_players = {1, 2, 3};
+        for (const auto &[time, p_out, p_in] : c.substitutions) {
+            our_team.subsitutions.emplace_back(time, p_out, p_in);
+        }
+        for (int time : c.goal_times) {
+            en_team.goals.emplace_back(time, 1, true, memory);
+        }
+
+        const auto expected =
+            reference_field_time(our_team, en_team, c.match_lenght);
+        const auto swept = LFL::Database::sweep_field_time(
+            our_team, en_team, players, c.match_lenght);
+        for (const auto &[number, time] : expected) {
+            if (swept[number].seconds != time.first or
+                swept[number].goals_against != time.second) {
+                std::cerr << "Test: Database::sweep_field_time: Player "
+                          << number << " does not match nested loops in '"
+                          << c.name << "'\n";
+            }
+        }
+        if (expected.at(1) != c.first) {
+            std::cerr << "Test: Database::sweep_field_time: Player 1 does "
+                         "not match expected in '"
+                      << c.name << "'\n";
+        }
+    }
+}
+
+void TEST_FILE_MANIFEST()
+{
+    Session session(":memory:");
+    auto &manifest = session.manifest();
+    manifest.record(MIngestedFile{"/a.xml", 100, 10, 7});
+    session.flush();
+
+    /// Runs is_changed on the file, with hash of contents returning hash
+    /// \returns (changed, hash was computed)
+    auto check = [&manifest](MIngestedFile file, long long hash) {
+        bool hashed = false;
+        const bool changed = manifest.is_changed(file, [&] {
+            hashed = true;
+            return hash;
+        });
+        return std::make_pair(changed, hashed);
+    };
+
+    const struct {
+        const char *name;
+        MIngestedFile file;
+        long long hash;
+        std::pair<bool, bool> expected;
+    } cases[] = {
+        {"new file", {"/b.xml", 100, 10, 0}, 7, {true, false}},
+        {"same size and time", {"/a.xml", 100, 10, 0}, 8, {false, false}},
+        {"new size", {"/a.xml", 101, 10, 0}, 7, {true, false}},
+        {"new time, new contents", {"/a.xml", 100, 11, 0}, 8, {true, true}},
+        {"new time, same contents", {"/a.xml", 100, 12, 0}, 7, {false, true}},
+    };
+    for (const auto &c : cases) {
+        if (check(c.file, c.hash) != c.expected) {
+            std::cerr << "Test: Database::FileManifest: Decision does not "
+                         "match expected for '"
+                      << c.name << "'\n";
+        }
+    }
+
+    // Only the new time of unchanged file is recorded, and flushed even
+    // without any game
+    if (!manifest.has_changes()) {
+        std::cerr << "Test: Database::FileManifest: New time of unchanged "
+                     "file is not recorded\n";
+    }
+    session.flush();
+    const auto files = session.storage.get_all<MIngestedFile>();
+    if (files.size() != 1 or files[0].mtime != 12 or files[0].hash != 7) {
+        std::cerr << "Test: Database::FileManifest: Flushed files do not "
+                     "match expected\n";
+    }
+    if (check({"/a.xml", 100, 12, 0}, 8) != std::make_pair(false, false)) {
+        std::cerr << "Test: Database::FileManifest: File with recorded new "
+                     "time is not unchanged\n";
+    }
+}
+
+/// \returns true if a is ranked before b, as report rankings were sorted
+/// in memory before they were ordered by SQLite. Ties are left for the
+/// stable sort by id.
+static bool reference_rank_before(PlayerRanking ranking,
+                                  const MPlayer &a,
+                                  const MPlayer &b)
+{
+    switch (ranking) {
+    case PlayerRanking::BEST_STRIKER:
+        if (a.points() != b.points())
+            return a.points() > b.points();
+        if (a.sum_goals() != b.sum_goals())
+            return a.sum_goals() > b.sum_goals();
+        if (a.point_per_h() != b.point_per_h())
+            return a.point_per_h() > b.point_per_h();
+        return false;
+    case PlayerRanking::MVP:
+        if (a.point_per_h() != b.point_per_h())
+            return a.point_per_h() > b.point_per_h();
+        if (a.seconds_on_field != b.seconds_on_field)
+            return a.seconds_on_field > b.seconds_on_field;
+        return false;
+    case PlayerRanking::GOALKEEPER:
+        if (a.gaa_per_h() != b.gaa_per_h())
+            return a.gaa_per_h() < b.gaa_per_h();
+        if (a.seconds_on_field != b.seconds_on_field)
+            return a.seconds_on_field > b.seconds_on_field;
+        return false;
+    case PlayerRanking::HARDWORKING:
+        return a.seconds_on_field > b.seconds_on_field;
+    }
+    return false;
+}
+
+void TEST_PLAYER_RANKING()
+{
+    Session session(":memory:");
+
+    // Few distinct values, so there are many ties, and players who did
+    // not play at all (division by zero)
+    std::mt19937 rng(7);
+    auto random = [&rng](int from, int to) {
+        return std::uniform_int_distribution<int>(from, to)(rng);
+    };
+    std::vector<MPlayer> players;
+    for (int i = 0; i < 200; i++) {
+        MPlayer player = {};
+        player.id = i + 1;
+        player.number = i;
+        player.team_id = 1;
+        player.p_type = static_cast<int>(
+            random(0, 2) == 0 ? PlayerType::GOALKEEPER : PlayerType::ATTACKER);
+        player.games = 1;
+        player.seconds_on_field = 600 * random(0, 3);
+        if (player.seconds_on_field != 0) {
+            player.goals = random(0, 2);
+            player.assists = random(0, 2);
+            player.goal_from_penalty = random(0, 1);
+            player.goalkeper_got_scores = random(0, 3);
+        }
+        players.push_back(player);
+    }
+    session.storage.replace_range(players.begin(), players.end());
+
+    const std::pair<PlayerRanking, const char *> rankings[] = {
+        {PlayerRanking::BEST_STRIKER, "best striker"},
+        {PlayerRanking::MVP, "mvp"},
+        {PlayerRanking::GOALKEEPER, "goalkeeper"},
+        {PlayerRanking::HARDWORKING, "hardworking"},
+    };
+    for (const auto &[ranking, name] : rankings) {
+        std::vector<MPlayer> expected;
+        for (const auto &player : players) {
+            if (ranking != PlayerRanking::GOALKEEPER or
+                player.p_type == static_cast<int>(PlayerType::GOALKEEPER))
+                expected.push_back(player);
+        }
+        // players are in order of id
+        std::stable_sort(expected.begin(),
+                         expected.end(),
+                         [ranking = ranking](const auto &a, const auto &b) {
+                             return reference_rank_before(ranking, a, b);
+                         });
+
+        for (size_t limit : {size_t(1), size_t(7), players.size()}) {
+            const auto ranked =
+                LFL::Database::rank_players(session.storage, ranking, limit);
+            bool same = ranked.size() == std::min(limit, expected.size());
+            for (size_t i = 0; same and i < ranked.size(); i++) {
+                same = ranked[i].id == expected[i].id;
+            }
+            if (!same) {
+                std::cerr << "Test: Database::rank_players: Order of '" << name
+                          << "' limited to " << limit
+                          << " does not match in memory sort\n";
+            }
+        }
+    }
+}
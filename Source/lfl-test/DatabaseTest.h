@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Database/Models.h"
+
+void TEST_INGEST_BATCH();
+void TEST_PLAYER_NUMBERS();
+void TEST_REPORT_FRAGMENTS();
+void TEST_HISTORY_MIGRATION();
+void TEST_CHANGED_PLAYERS_FLUSH();
+void TEST_HTML_WRITER();
+void TEST_FIELD_TIME();
+void TEST_FILE_MANIFEST();
+void TEST_PLAYER_RANKING();
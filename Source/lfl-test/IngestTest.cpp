@@ -0,0 +1,118 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "IngestTest.h"
+#include "lfl-bench/ProtocolGenerator.h"
+
+using LFL::Database::MMatchHistory;
+using LFL::Database::MPlayer;
+using LFL::Database::MTeam;
+using LFL::Database::Session;
+using LFL::Database::Storage;
+
+/// Writes games generated from fixed seed to empty directory
+static std::filesystem::path write_generated(const std::string &name,
+                                             size_t games)
+{
+    const auto dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    LFL::Bench::ProtocolGenerator generator(LFL::Bench::ProtocolShape(), 6, 1);
+    LFL::Bench::write_protocols(generator, dir.string(), games);
+    return dir;
+}
+
+/// \returns all teams, players and history rows, ordered by id
+static std::string dump_league(Storage &storage)
+{
+    std::ostringstream out;
+    for (const auto &t : storage.get_all<MTeam>()) {
+        out << "team " << t.id << ' ' << t.name << ' ' << t.games << ' '
+            << t.wins << ' ' << t.loses << ' ' << t.wins_in_overtime << ' '
+            << t.loses_in_overtime << ' ' << t.points << ' ' << t.goals_for
+            << ' ' << t.goals_again << ' ' << t.sum_of_attendance << '\n';
+    }
+    for (const auto &p : storage.get_all<MPlayer>()) {
+        out << "player " << p.id << ' ' << p.number << ' ' << p.name << ' '
+            << p.surname << ' ' << p.team_id << ' ' << p.p_type << ' '
+            << p.games << ' ' << p.seconds_on_field << ' ' << p.yellow_cards
+            << ' ' << p.red_cards << ' ' << p.goals << ' ' << p.assists << ' '
+            << p.goal_from_penalty << ' ' << p.goalkeper_got_scores << '\n';
+    }
+    for (const auto &h : storage.get_all<MMatchHistory>()) {
+        out << "history " << h.id << ' ' << h.team_id << ' ' << h.date
+            << '\n';
+    }
+    return out.str();
+}
+
+void TEST_INGEST_JOBS()
+{
+    const auto dir = write_generated("lfl-test-ingest-jobs", 40);
+
+    std::string expected;
+    for (size_t jobs : {1, 4}) {
+        Session session(":memory:");
+        LFL::Ingest::process_directory(session, dir.string(), jobs, 0, false);
+        const auto tables = dump_league(session.storage);
+        if (jobs == 1) {
+            expected = tables;
+        }
+        else if (tables != expected) {
+            std::cerr << "Test: Ingest::process_directory: Tables recorded "
+                         "with "
+                      << jobs << " jobs differ from 1 job\n";
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
+
+void TEST_INGEST_ERROR()
+{
+    // Files before game00005.xml are recorded, one game per commit
+    const size_t bad = 5;
+    const auto dir = write_generated("lfl-test-ingest-error", 12);
+    const auto bad_file = (dir / "game00005.xml").string();
+    std::ofstream(bad_file, std::ios::binary) << "<Spele Laiks=\"2022/01/01\"";
+
+    // Same games as before the malformed file
+    const auto before_dir = write_generated("lfl-test-ingest-before", bad);
+    std::string expected;
+    {
+        Session session(":memory:");
+        LFL::Ingest::process_directory(
+            session, before_dir.string(), 1, 1, false);
+        expected = dump_league(session.storage);
+    }
+
+    for (size_t jobs : {1, 4}) {
+        Session session(":memory:");
+        bool thrown = false;
+        try {
+            LFL::Ingest::process_directory(
+                session, dir.string(), jobs, 1, false);
+        }
+        catch (const LFL::Ingest::FileError &e) {
+            thrown = true;
+            if (e.file() != bad_file) {
+                std::cerr << "Test: Ingest::process_directory: Error names "
+                             "wrong file '"
+                          << e.file() << "'\n";
+            }
+        }
+        if (!thrown) {
+            std::cerr << "Test: Ingest::process_directory: Malformed file "
+                         "did not throw\n";
+        }
+        if (dump_league(session.storage) != expected or
+            session.storage.count<LFL::Database::MIngestedFile>() != bad) {
+            std::cerr << "Test: Ingest::process_directory: Games before "
+                         "malformed file were not kept exactly, with "
+                      << jobs << " jobs\n";
+        }
+    }
+    std::filesystem::remove_all(dir);
+    std::filesystem::remove_all(before_dir);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "lfl/Ingest.h"
+
+void TEST_INGEST_JOBS();
+void TEST_INGEST_ERROR();
@@ -0,0 +1,22 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "UtilsTest.h"
+
+void TEST_HASH()
+{
+    // Reference XXH64 values
+    const std::pair<std::string, uint64_t> cases[] = {
+        {"", 0xEF46DB3751D8E999ull},
+        {"abc", 0x44BC2CF5AD770999ull},
+        {std::string(100, 'x'), 0x92F0DE5A88A3C094ull},
+    };
+    for (const auto &[text, expected] : cases) {
+        if (LFL::Utils::hash64(text.data(), text.size()) != expected) {
+            std::cerr << "Test: Utils::hash64: Hash of " << text.size()
+                      << " bytes does not match reference\n";
+        }
+    }
+}
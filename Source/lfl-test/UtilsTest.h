@@ -0,0 +1,5 @@
+#pragma once
+
+#include "Utils/Hash.h"
+
+void TEST_HASH();
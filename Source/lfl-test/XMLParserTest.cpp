@@ -1,7 +1,12 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <string>
 
 #include "XMLParserTest.h"
+#include "XMLParser/GameCache.h"
+#include "XMLParser/Schema.h"
 
 #include "rapidxml.hpp"
 
@@ -31,3 +36,399 @@ void TEST_XML_PARSER()
                      "not match expected\n";
     }
 }
+
+void TEST_ATTRIBUTE_VIEW()
+{
+    char input[] = "<Speletajs Loma='V' Uzvards='Sam' Vards='Sidney' Nr='16'/>";
+
+    xml_document<> doc;
+    doc.parse<0>(input);
+
+    const LFL::XMLParser::AttributeView attr(doc.first_node("Speletajs"));
+
+    if (attr.at("Uzvards") != "Sam" or attr.at("Nr") != "16") {
+        std::cerr << "Test: XMLParser::AttributeView: Attribute value does "
+                     "not match expected\n";
+    }
+    if (!attr.contains("Loma") or attr.contains("Laiks")) {
+        std::cerr << "Test: XMLParser::AttributeView: contains() does not "
+                     "match expected\n";
+    }
+
+    bool thrown = false;
+    try {
+        attr.at("Laiks");
+    }
+    catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        std::cerr << "Test: XMLParser::AttributeView: Missing attribute did "
+                     "not throw\n";
+    }
+
+    const LFL::XMLParser::Data::Player player(attr,
+                                              LFL::XMLParser::GameMemory());
+    if (player.name != "Sidney" or player.number != 16 or
+        player.p_type != LFL::XMLParser::Data::PlayerType::GOALKEEPER) {
+        std::cerr << "Test: XMLParser::Data::Player: Parsed player does not "
+                     "match expected\n";
+    }
+}
+
+void TEST_VALUE_PARSING()
+{
+    using LFL::XMLParser::parse_int;
+    using LFL::XMLParser::parse_time;
+
+    if (parse_int("16") != 16 or parse_int("0") != 0) {
+        std::cerr << "Test: XMLParser::parse_int: Parsed number does not "
+                     "match expected\n";
+    }
+    if (parse_time("12:05") != 725 or parse_time("63:59") != 3839) {
+        std::cerr << "Test: XMLParser::parse_time: Parsed time does not "
+                     "match expected\n";
+    }
+
+    auto throws = [](auto parser, const char *str) {
+        try {
+            parser(str);
+        }
+        catch (const LFL::XMLParser::ParseError &) {
+            return true;
+        }
+        return false;
+    };
+
+    for (const char *str : {"", "-1", "1a", " 1", "99999999999"}) {
+        if (!throws(parse_int, str)) {
+            std::cerr << "Test: XMLParser::parse_int: Malformed number '"
+                      << str << "' did not throw\n";
+        }
+    }
+    for (const char *str :
+         {"", "12", "12:", ":05", "12:60", "1:2:3", "99999999:00"}) {
+        if (!throws(parse_time, str)) {
+            std::cerr << "Test: XMLParser::parse_time: Malformed time '" << str
+                      << "' did not throw\n";
+        }
+    }
+}
+
+void TEST_INPUT_FILE()
+{
+    const auto path =
+        (std::filesystem::temp_directory_path() / "lfl-test-input.xml")
+            .string();
+
+    LFL::XMLParser::InputFile input;
+    // Page sized file has no room for terminator in mapping, and is read
+    for (size_t size : {100, 4096, 5000}) {
+        const std::string content(size, 'x');
+        std::ofstream(path, std::ios::binary) << content;
+
+        const char *data = input.open(path);
+        if (input.size() != size or std::strlen(data) != size or
+            std::memcmp(data, content.data(), size) != 0) {
+            std::cerr << "Test: XMLParser::InputFile: File of " << size
+                      << " bytes does not match written\n";
+        }
+    }
+    input.close();
+
+    std::filesystem::remove(path);
+}
+
+/// \returns true if both parsers built the same game
+static bool same_games(const LFL::XMLParser::Data::Game &a,
+                       const LFL::XMLParser::Data::Game &b)
+{
+    if (a.date != b.date or a.place != b.place or
+        a.attendance != b.attendance or a.teams.size() != b.teams.size() or
+        a.referees.size() != b.referees.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.referees.size(); i++) {
+        const auto &ra = a.referees[i];
+        const auto &rb = b.referees[i];
+        if (ra.name != rb.name or ra.surname != rb.surname or
+            ra.main != rb.main) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < a.teams.size(); i++) {
+        const auto &ta = a.teams[i];
+        const auto &tb = b.teams[i];
+        if (ta.name != tb.name or ta.starting_players != tb.starting_players or
+            ta.players.size() != tb.players.size() or
+            ta.subsitutions.size() != tb.subsitutions.size() or
+            ta.penalties.size() != tb.penalties.size() or
+            ta.goals.size() != tb.goals.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < ta.players.size(); j++) {
+            const auto &pa = ta.players[j];
+            const auto &pb = tb.players[j];
+            if (pa.name != pb.name or pa.surname != pb.surname or
+                pa.number != pb.number or pa.p_type != pb.p_type) {
+                return false;
+            }
+        }
+        for (size_t j = 0; j < ta.subsitutions.size(); j++) {
+            const auto &sa = ta.subsitutions[j];
+            const auto &sb = tb.subsitutions[j];
+            if (sa.time != sb.time or sa.p_out != sb.p_out or
+                sa.p_in != sb.p_in) {
+                return false;
+            }
+        }
+        for (size_t j = 0; j < ta.penalties.size(); j++) {
+            if (ta.penalties[j].time != tb.penalties[j].time or
+                ta.penalties[j].number != tb.penalties[j].number) {
+                return false;
+            }
+        }
+        for (size_t j = 0; j < ta.goals.size(); j++) {
+            const auto &ga = ta.goals[j];
+            const auto &gb = tb.goals[j];
+            if (ga.time != gb.time or ga.number != gb.number or
+                ga.from_game != gb.from_game or ga.assists != gb.assists) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void TEST_STREAM_PARSER()
+{
+    using LFL::XMLParser::Frontend;
+    using LFL::XMLParser::ParserContext;
+
+    const auto path =
+        (std::filesystem::temp_directory_path() / "lfl-test-protocol.xml")
+            .string();
+    std::ofstream(path, std::ios::binary)
+        << "\xEF\xBB\xBF<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<!-- exported protocol -->\n"
+           "<Spele Laiks=\"2022/01/01\" Skatitaji=\"500\" Vieta='R&#x12B;ga'>\n"
+           "  <VT Vards=\"Main\" Uzvards=\"Ref\"/>\n"
+           "  <T Vards=\"R1\" Uzvards=\"X\"></T><T Vards='R2' Uzvards='Y'/>\n"
+           "  <Komanda Nosaukums=\"A&amp;B &lt;FC&gt;\">\n"
+           "    <Speletaji>\n"
+           "      <Speletajs Vards=\"O&apos;Neil\" Uzvards=\"&quot;S&quot;\""
+           " Loma=\"V\" Nr=\"1\"/>\n"
+           "      <Speletajs Vards='Anna' Uzvards='B' Loma='U' Nr='7' />\n"
+           "    </Speletaji>\n"
+           "    <Treneris Vards=\"Unknown\"><Speletajs Nr=\"9\"/></Treneris>\n"
+           "    <Pamatsastavs><Speletajs Nr=\"1\"/></Pamatsastavs>\n"
+           "    <Mainas><Maina Laiks=\"12:05\" Nr1=\"1\" Nr2=\"7\"/></Mainas>\n"
+           "    <Sodi><Sods Laiks=\"13:00\" Nr=\"7\"/></Sodi>\n"
+           "    <Varti>\n"
+           "      <VG Laiks=\"20:01\" Nr=\"7\" Sitiens=\"J\">"
+           "<P Nr=\"1\"/><P Nr=\"9\"/></VG>\n"
+           "      <VG Laiks=\"61:30\" Nr=\"1\" Sitiens=\"N\"/>\n"
+           "    </Varti>\n"
+           "  </Komanda>\n"
+           "  <Komanda Nosaukums=\"Empty\">"
+           "<Speletaji/><Pamatsastavs></Pamatsastavs></Komanda>\n"
+           "</Spele>\n";
+
+    LFL::XMLParser::GameMemory memory;
+    ParserContext dom(Frontend::DOM);
+    ParserContext streaming(Frontend::STREAMING);
+    const auto expected = dom.parse_game_file(path, memory);
+    const auto game = streaming.parse_game_file(path, memory);
+
+    if (!same_games(game, expected)) {
+        std::cerr << "Test: XMLParser::StreamParser: Parsed game does not "
+                     "match DOM parser\n";
+    }
+    if (game.place != "R\xC4\xABga" or game.teams.size() != 2 or
+        game.teams[0].name != "A&B <FC>" or
+        game.teams[0].players[0].name != "O'Neil" or
+        game.teams[0].goals[0].assists.size() != 2 or
+        !game.referees.back().main) {
+        std::cerr << "Test: XMLParser::StreamParser: Parsed game does not "
+                     "match expected\n";
+    }
+
+    std::ofstream(path, std::ios::binary)
+        << "<Spele Laiks=\"2022/01/01\" Vieta=\"Riga\"><X></Spele>";
+    bool thrown = false;
+    try {
+        streaming.parse_game_file(path, memory);
+    }
+    catch (const LFL::XMLParser::ParseError &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        std::cerr << "Test: XMLParser::StreamParser: Mismatched end tag did "
+                     "not throw\n";
+    }
+
+    // Numeric entities are only digits of the base
+    for (const char *entity : {"&#-1;", "&# 65;", "&#+65;", "&#x;", "&#65"}) {
+        std::ofstream(path, std::ios::binary)
+            << "<Spele Laiks=\"2022/01/01\" Vieta=\"R" << entity
+            << "\"></Spele>";
+        thrown = false;
+        try {
+            streaming.parse_game_file(path, memory);
+        }
+        catch (const LFL::XMLParser::ParseError &) {
+            thrown = true;
+        }
+        if (!thrown) {
+            std::cerr << "Test: XMLParser::StreamParser: Malformed entity '"
+                      << entity << "' did not throw\n";
+        }
+    }
+
+    // Required subnodes are reported, not asserted
+    std::ofstream(path, std::ios::binary)
+        << "<Spele Laiks=\"2022/01/01\" Vieta=\"Riga\">"
+           "<Komanda Nosaukums=\"A\"><Pamatsastavs/></Komanda></Spele>";
+    for (ParserContext *parser : {&dom, &streaming}) {
+        thrown = false;
+        try {
+            parser->parse_game_file(path, memory);
+        }
+        catch (const LFL::XMLParser::ParseError &) {
+            thrown = true;
+        }
+        if (!thrown) {
+            std::cerr << "Test: XMLParser::ParserContext: Missing Speletaji "
+                         "did not throw\n";
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+void TEST_SCHEMA()
+{
+    namespace Schema = LFL::XMLParser::Schema;
+
+    for (size_t i = 0; i < Schema::NAME_COUNT; i++) {
+        if (Schema::name_id(Schema::NAMES[i]) != static_cast<int>(i)) {
+            std::cerr << "Test: XMLParser::Schema: Name '" << Schema::NAMES[i]
+                      << "' is not found\n";
+        }
+    }
+    for (const char *name : {"", "Nr3", "speletajs", "Treneris"}) {
+        if (Schema::name_id(name) != -1) {
+            std::cerr << "Test: XMLParser::Schema: Unknown name '" << name
+                      << "' is found\n";
+        }
+    }
+
+    // Repeated attribute is bound only once, missing one throws
+    char input[] = "<Maina Nr2='7' Laiks='01:00' Nr1='3' Nr2='8'/>"
+                   "<Maina Nr1='3'/>";
+    xml_document<> doc;
+    doc.parse<0>(input);
+
+    auto *node = doc.first_node("Maina");
+    const LFL::XMLParser::Data::Substitution sub(
+        LFL::XMLParser::AttributeView{node});
+    if (sub.time != 60 or sub.p_out != 3 or sub.p_in != 7) {
+        std::cerr << "Test: XMLParser::Schema: Bound substitution does not "
+                     "match expected\n";
+    }
+
+    bool thrown = false;
+    try {
+        LFL::XMLParser::Data::Substitution(
+            LFL::XMLParser::AttributeView{node->next_sibling("Maina")});
+    }
+    catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    if (!thrown) {
+        std::cerr << "Test: XMLParser::Schema: Missing attribute did not "
+                     "throw\n";
+    }
+}
+
+void TEST_GAME_CACHE()
+{
+    using LFL::XMLParser::GameCache;
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto path = (dir / "lfl-test-cached.xml").string();
+    const auto cache_path = GameCache::path_of(path);
+    std::ofstream(path, std::ios::binary)
+        << "<Spele Laiks=\"2022/01/01\" Skatitaji=\"500\" Vieta=\"Riga\">"
+           "<VT Vards=\"Main\" Uzvards=\"Ref\"/><T Vards=\"R\" Uzvards=\"X\"/>"
+           "<Komanda Nosaukums=\"A\"><Speletaji>"
+           "<Speletajs Vards=\"Ann\" Uzvards=\"B\" Loma=\"V\" Nr=\"1\"/>"
+           "<Speletajs Vards=\"Ann\" Uzvards=\"C\" Loma=\"U\" Nr=\"7\"/>"
+           "</Speletaji><Pamatsastavs><Speletajs Nr=\"1\"/></Pamatsastavs>"
+           "<Mainas><Maina Laiks=\"12:05\" Nr1=\"1\" Nr2=\"7\"/></Mainas>"
+           "<Sodi><Sods Laiks=\"13:00\" Nr=\"7\"/></Sodi><Varti>"
+           "<VG Laiks=\"20:01\" Nr=\"7\" Sitiens=\"J\"><P Nr=\"1\"/></VG>"
+           "<VG Laiks=\"61:30\" Nr=\"1\" Sitiens=\"N\"/></Varti></Komanda>"
+           "<Komanda Nosaukums=\"B\"><Speletaji/><Pamatsastavs/></Komanda>"
+           "</Spele>";
+
+    LFL::XMLParser::GameMemory memory;
+    LFL::XMLParser::ParserContext parser;
+    const auto expected = parser.parse_game_file(path, memory);
+
+    // Protocol is never read by the cache, only its size and time matter
+    GameCache cache;
+    const LFL::XMLParser::CacheSource written{100, 200, 1};
+    size_t hashed = 0;
+    uint64_t contents = 1;
+    auto hash = [&] {
+        hashed++;
+        return contents;
+    };
+    auto read = [&](int64_t size, int64_t mtime) {
+        LFL::XMLParser::CacheSource source{size, mtime, 0};
+        auto res = cache.read(cache_path, source, hash, memory);
+        if (res and source.hash != written.hash) {
+            std::cerr << "Test: XMLParser::GameCache: Hash of read game is "
+                      << source.hash << "\n";
+        }
+        return res;
+    };
+
+    if (read(100, 200)) {
+        std::cerr << "Test: XMLParser::GameCache: Missing file was read\n";
+    }
+    cache.write(cache_path, expected, written);
+
+    const auto game = read(100, 200);
+    if (!game or !same_games(*game, expected)) {
+        std::cerr << "Test: XMLParser::GameCache: Read game does not match "
+                     "written\n";
+    }
+    if (hashed != 0) {
+        std::cerr << "Test: XMLParser::GameCache: Protocol of the same size "
+                     "and time was hashed\n";
+    }
+    if (read(101, 200) or hashed != 0) {
+        std::cerr << "Test: XMLParser::GameCache: Cache of other size was "
+                     "read or hashed\n";
+    }
+    if (!read(100, 300) or hashed != 1) {
+        std::cerr << "Test: XMLParser::GameCache: Touched protocol was not "
+                     "read by hash\n";
+    }
+    contents = 2;
+    if (read(100, 300)) {
+        std::cerr << "Test: XMLParser::GameCache: Cache of other contents "
+                     "was read\n";
+    }
+
+    std::filesystem::resize_file(
+        cache_path, std::filesystem::file_size(cache_path) - 4);
+    if (read(100, 200)) {
+        std::cerr << "Test: XMLParser::GameCache: Truncated file was read\n";
+    }
+
+    std::filesystem::remove(cache_path);
+    std::filesystem::remove(path);
+}
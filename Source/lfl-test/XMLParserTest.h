@@ -3,3 +3,9 @@
 #include "XMLParser/Parser.h"
 
 void TEST_XML_PARSER();
+void TEST_ATTRIBUTE_VIEW();
+void TEST_VALUE_PARSING();
+void TEST_INPUT_FILE();
+void TEST_STREAM_PARSER();
+void TEST_SCHEMA();
+void TEST_GAME_CACHE();
@@ -1,8 +1,32 @@
+#include "DatabaseTest.h"
+#include "IngestTest.h"
+#include "UtilsTest.h"
 #include "XMLParserTest.h"
 
 int main()
 {
     TEST_XML_PARSER();
+    TEST_ATTRIBUTE_VIEW();
+    TEST_VALUE_PARSING();
+    TEST_INPUT_FILE();
+    TEST_STREAM_PARSER();
+    TEST_SCHEMA();
+    TEST_GAME_CACHE();
+
+    TEST_HASH();
+
+    TEST_INGEST_BATCH();
+    TEST_PLAYER_NUMBERS();
+    TEST_REPORT_FRAGMENTS();
+    TEST_HISTORY_MIGRATION();
+    TEST_CHANGED_PLAYERS_FLUSH();
+    TEST_HTML_WRITER();
+    TEST_FIELD_TIME();
+    TEST_FILE_MANIFEST();
+    TEST_PLAYER_RANKING();
+
+    TEST_INGEST_JOBS();
+    TEST_INGEST_ERROR();
 
     return 0;
 }
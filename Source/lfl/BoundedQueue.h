@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace LFL::Ingest {
+
+    /// Fixed capacity multi-producer/multi-consumer queue.
+    /// push() blocks while the queue is full, pop() blocks while it is empty.
+    /// After close() producers can not push anymore, and pop() returns
+    /// std::nullopt once remaining items are drained.
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity)
+            : capacity_(capacity == 0 ? 1 : capacity)
+        {
+        }
+
+        /// \returns false if queue was closed and item was dropped.
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock,
+                           [this] { return closed_ or items_.size() < capacity_; });
+            if (closed_)
+                return false;
+
+            items_.push_back(std::move(item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        std::optional<T> pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this] { return closed_ or !items_.empty(); });
+            if (items_.empty())
+                return std::nullopt;
+
+            T item = std::move(items_.front());
+            items_.pop_front();
+            not_full_.notify_one();
+            return item;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+    private:
+        const size_t capacity_;
+        bool closed_ = false;
+        std::deque<T> items_;
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+    };
+}  // namespace LFL::Ingest
@@ -0,0 +1,396 @@
+#include "Ingest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Database/Manifest.h"
+#include "Database/Models.h"
+#include "Utils/Hash.h"
+#include "Utils/Timing.h"
+#include "XMLParser/GameCache.h"
+#include "XMLParser/Parser.h"
+
+namespace LFL::Ingest {
+
+    /// XML file to process, and its state recorded after processing
+    struct SourceFile {
+        std::string name;
+        Database::MIngestedFile state;
+    };
+
+    /// \returns file with its current size and last write time, without
+    /// hash
+    static SourceFile stat_file(const std::string &name)
+    {
+        namespace fs = std::filesystem;
+        const fs::path path = fs::absolute(name).lexically_normal();
+        return SourceFile{
+            name,
+            Database::MIngestedFile{
+                path.string(),
+                static_cast<long long>(fs::file_size(path)),
+                static_cast<long long>(
+                    fs::last_write_time(path).time_since_epoch().count()),
+                0}};
+    }
+
+    /// Opens the file in input, it is kept open to be parsed without
+    /// reading it again
+    /// \returns Utils::hash64 of file contents, as stored in the manifest
+    static long long open_and_hash(XMLParser::InputFile &input,
+                                   const std::string &name)
+    {
+        const char *text = input.open(name);
+        return static_cast<long long>(Utils::hash64(text, input.size()));
+    }
+
+    /// \returns game of the file, read from its binary cache if cache is
+    /// given and holds the current contents, otherwise parsed from XML (and
+    /// written to the cache). Hash of the file is filled in, XML is not read
+    /// at all if cache was written from file of the same size and last
+    /// write time.
+    static XMLParser::Data::Game load_game(XMLParser::ParserContext &parser,
+                                           XMLParser::GameCache *cache,
+                                           XMLParser::InputFile &input,
+                                           SourceFile &file,
+                                           const XMLParser::GameMemory &memory)
+    {
+        if (cache == nullptr) {
+            {
+                Utils::ScopedTimer timer(Utils::Stage::READ);
+                file.state.hash = open_and_hash(input, file.name);
+            }
+            return parser.parse_game_file(input, memory);
+        }
+
+        const std::string path = XMLParser::GameCache::path_of(file.name);
+        XMLParser::CacheSource source{file.state.size, file.state.mtime, 0};
+        bool hashed = false;
+        auto hash = [&] {
+            source.hash =
+                static_cast<uint64_t>(open_and_hash(input, file.name));
+            hashed = true;
+            return source.hash;
+        };
+        {
+            Utils::ScopedTimer timer(Utils::Stage::READ);
+            auto game = cache->read(path, source, hash, memory);
+            if (game) {
+                input.close();
+                file.state.hash = static_cast<long long>(source.hash);
+                return std::move(*game);
+            }
+            if (!hashed)
+                hash();
+        }
+
+        file.state.hash = static_cast<long long>(source.hash);
+        auto game = parser.parse_game_file(input, memory);
+        try {
+            cache->write(path, game, source);
+        }
+        catch (const std::runtime_error &e) {
+            // Game is still recorded, only the next run parses it again
+            std::cout << "Not caching '" << file.name << "': " << e.what()
+                      << std::endl;
+        }
+        return game;
+    }
+
+    /// Rethrows exception being handled, as FileError if it is caused by
+    /// contents of the file. Must be called from catch block.
+    [[noreturn]] static void rethrow_for_file(const std::string &name)
+    {
+        try {
+            throw;
+        }
+        catch (const XMLParser::ParseError &e) {
+            throw FileError(name, e.what());
+        }
+        catch (const rapidxml::parse_error &e) {
+            throw FileError(name, std::string("Malformed XML, ") + e.what());
+        }
+        catch (const std::out_of_range &e) {
+            throw FileError(name, e.what());
+        }
+    }
+
+    static void process_xml_file(Database::IngestBatch &batch,
+                                 XMLParser::ParserContext &parser,
+                                 XMLParser::GameCache *cache,
+                                 XMLParser::InputFile &input,
+                                 XMLParser::GameArena &arena,
+                                 SourceFile file)
+    {
+        const auto start_time = std::chrono::steady_clock::now();
+        const std::string &name = file.name;
+        Utils::FileScope scope(name);
+
+        try {
+            auto game = load_game(parser, cache, input, file, arena.memory());
+            batch.add(game, file.state);
+        }
+        catch (...) {
+            rethrow_for_file(name);
+        }
+        arena.reset();
+
+        const double time = Utils::elapsed_ms(start_time);
+        std::cout << "Processed '" << name << "' in " << time << " ms"
+                  << std::endl;
+    }
+
+    void process_single_xml_file(Database::Session &session,
+                                 const std::string &name,
+                                 bool use_cache)
+    {
+        Database::IngestBatch batch(session, 0);
+        XMLParser::ParserContext parser;
+        XMLParser::GameCache cache;
+        XMLParser::InputFile input;
+        XMLParser::GameArena arena;
+        process_xml_file(batch,
+                         parser,
+                         use_cache ? &cache : nullptr,
+                         input,
+                         arena,
+                         stat_file(name));
+        batch.commit();
+    }
+
+    /// \returns XML files of the directory, sorted by name so games are
+    /// recorded in the same order on every run
+    static std::vector<std::string> list_xml_files(const std::string &dir)
+    {
+        std::vector<std::string> res;
+        for (auto const &dir_entry :
+             std::filesystem::directory_iterator{std::filesystem::path{dir}}) {
+            const auto extension = dir_entry.path().extension();
+            if (extension == ".xml") {
+                res.push_back(dir_entry.path().string());
+            }
+            else if (extension == XMLParser::GameCache::EXTENSION or
+                     (extension == XMLParser::GameCache::TEMPORARY_EXTENSION and
+                      dir_entry.path().stem().extension() ==
+                          XMLParser::GameCache::EXTENSION)) {
+                // Written by --cache next to protocols, temporary one is
+                // left behind if lfl was killed while writing it
+            }
+            else {
+                std::cout << "Skipping non XML file '" << dir_entry << "'."
+                          << std::endl;
+            }
+        }
+        // directory_iterator order is unspecified
+        std::sort(res.begin(), res.end());
+        return res;
+    }
+
+    /// Drops files, that did not change since they were recorded in the
+    /// manifest, see Database::FileManifest::is_changed
+    /// \returns files to process
+    static std::vector<SourceFile> changed_files(
+        Database::Session &session,
+        const std::vector<std::string> &files)
+    {
+        auto &manifest = session.manifest();
+        XMLParser::InputFile input;
+
+        std::vector<SourceFile> res;
+        size_t unchanged = 0;
+        for (const auto &name : files) {
+            SourceFile file = stat_file(name);
+            auto hash = [&] {
+                Utils::ScopedTimer timer(Utils::Stage::READ);
+                return open_and_hash(input, name);
+            };
+            if (manifest.is_changed(file.state, hash)) {
+                res.push_back(std::move(file));
+            }
+            else {
+                unchanged++;
+            }
+        }
+
+        if (unchanged != 0) {
+            std::cout << "Skipping " << unchanged << " unchanged file(s)"
+                      << std::endl;
+        }
+        return res;
+    }
+
+    /// Unit of work passed from parser threads to database writer.
+    struct ParsedFile {
+        /// Index in the file list, games are recorded in this order
+        size_t index;
+        SourceFile file;
+        /// Memory of the game, returned to the pool after it is recorded
+        std::unique_ptr<XMLParser::GameArena> arena;
+        std::optional<XMLParser::Data::Game> game;
+        /// Set if parsing failed, rethrown by the writer.
+        std::exception_ptr error;
+        /// Wall time spent parsing, in ms
+        double parse_time = 0;
+    };
+
+    static void process_files_in_parallel(Database::IngestBatch &batch,
+                                          const std::vector<SourceFile> &files,
+                                          size_t jobs,
+                                          bool use_cache)
+    {
+        const size_t queue_size = 2 * jobs;
+        BoundedQueue<ParsedFile> queue(queue_size);
+        std::atomic<size_t> next_file{0};
+        std::atomic<size_t> running_workers{jobs};
+
+        // Every game in flight (being parsed, queued or recorded) owns an
+        // arena, arenas are reused once game is recorded.
+        const size_t arena_count = queue_size + jobs + 1;
+        BoundedQueue<std::unique_ptr<XMLParser::GameArena>> free_arenas(
+            arena_count);
+        for (size_t i = 0; i < arena_count; i++) {
+            free_arenas.push(std::make_unique<XMLParser::GameArena>());
+        }
+
+        auto worker = [&] {
+            XMLParser::ParserContext parser;
+            XMLParser::GameCache cache;
+            XMLParser::InputFile input;
+            while (true) {
+                // Arena is taken before the file index, so the file the
+                // writer waits for already has one, even when all others are
+                // held by the reorder buffer
+                auto arena = free_arenas.pop();
+                if (!arena)
+                    break;  // writer gave up
+                const size_t i = next_file++;
+                if (i >= files.size())
+                    break;
+
+                ParsedFile item{
+                    i, files[i], std::move(*arena), std::nullopt, nullptr};
+
+                const auto start = std::chrono::steady_clock::now();
+                try {
+                    Utils::FileScope scope(item.file.name);
+                    item.game.emplace(load_game(parser,
+                                                use_cache ? &cache : nullptr,
+                                                input,
+                                                item.file,
+                                                item.arena->memory()));
+                }
+                catch (...) {
+                    item.error = std::current_exception();
+                }
+                item.parse_time = Utils::elapsed_ms(start);
+
+                if (!queue.push(std::move(item)))
+                    break;  // writer gave up
+            }
+
+            if (--running_workers == 0)
+                queue.close();
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < jobs; i++) {
+            workers.emplace_back(worker);
+        }
+
+        auto join_workers = [&workers] {
+            for (auto &w : workers) {
+                w.join();
+            }
+        };
+
+        try {
+            // This thread is the only one that touches the database. Files
+            // finish out of order, they wait in the reorder buffer until all
+            // files before them are recorded, so result does not depend on
+            // jobs count.
+            std::map<size_t, ParsedFile> reorder;
+            size_t next_to_record = 0;
+            while (auto parsed = queue.pop()) {
+                reorder.emplace(parsed->index, std::move(*parsed));
+
+                for (auto it = reorder.find(next_to_record);
+                     it != reorder.end();
+                     it = reorder.find(next_to_record)) {
+                    ParsedFile &item = it->second;
+                    const auto start = std::chrono::steady_clock::now();
+                    Utils::FileScope scope(item.file.name);
+                    try {
+                        if (item.error)
+                            std::rethrow_exception(item.error);
+                        batch.add(*item.game, item.file.state);
+                    }
+                    catch (...) {
+                        rethrow_for_file(item.file.name);
+                    }
+
+                    item.game.reset();
+                    item.arena->reset();
+                    free_arenas.push(std::move(item.arena));
+
+                    std::cout << "Processed '" << item.file.name << "' in "
+                              << item.parse_time + Utils::elapsed_ms(start)
+                              << " ms" << std::endl;
+                    reorder.erase(it);
+                    next_to_record++;
+                }
+            }
+        }
+        catch (...) {
+            queue.close();
+            free_arenas.close();
+            join_workers();
+            throw;
+        }
+
+        join_workers();
+    }
+
+    void process_directory(Database::Session &session,
+                           const std::string &dir,
+                           size_t jobs,
+                           size_t batch_size,
+                           bool use_cache)
+    {
+        const auto files = changed_files(session, list_xml_files(dir));
+
+        Database::IngestBatch batch(session, batch_size);
+        if (jobs <= 1 or files.size() <= 1) {
+            XMLParser::ParserContext parser;
+            XMLParser::GameCache cache;
+            XMLParser::InputFile input;
+            XMLParser::GameArena arena;
+            for (const auto &file : files) {
+                process_xml_file(batch,
+                                 parser,
+                                 use_cache ? &cache : nullptr,
+                                 input,
+                                 arena,
+                                 file);
+            }
+        }
+        else {
+            process_files_in_parallel(
+                batch, files, std::min(jobs, files.size()), use_cache);
+        }
+        batch.commit();
+        // New write times of unchanged files, if there was no game
+        session.flush();
+    }
+}  // namespace LFL::Ingest
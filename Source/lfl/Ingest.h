@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "Database/Models.h"
+
+namespace LFL::Ingest {
+
+    /// Thrown when protocol file is malformed, or its contents can not be
+    /// recorded.
+    class FileError : public std::runtime_error {
+    public:
+        FileError(const std::string &file, const std::string &what)
+            : std::runtime_error(what)
+            , file_(file)
+        {
+        }
+
+        /// \returns name of the protocol file
+        const std::string &file() const { return file_; }
+
+    private:
+        std::string file_;
+    };
+
+    /// Parses and records single XML protocol file
+    /// \param use_cache read game from XMLParser::GameCache file next to the
+    /// protocol if it matches protocol contents, otherwise write it there
+    /// \throws FileError if file is malformed
+    void process_single_xml_file(Database::Session &session,
+                                 const std::string &name,
+                                 bool use_cache);
+
+    /// Processes all XML files in given directory.
+    /// \param jobs count of parser threads, if it is bigger than one files are
+    /// parsed concurrently and handed over to single database writer (calling
+    /// thread) through bounded queue.
+    /// \param batch_size games recorded per transaction, 0 to record whole
+    /// directory in one transaction.
+    /// \param use_cache see process_single_xml_file
+    /// \throws FileError if some file is malformed, games of the directory
+    /// are kept or dropped as described by Database::IngestBatch
+    void process_directory(Database::Session &session,
+                           const std::string &dir,
+                           size_t jobs,
+                           size_t batch_size,
+                           bool use_cache);
+}  // namespace LFL::Ingest
@@ -1,20 +1,12 @@
-#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "Database/Models.h"
-#include "XMLParser/Parser.h"
-
-void process_single_xml_file(const std::string &name)
-{
-    double start_time = clock();
-
-    auto game = LFL::XMLParser::parse_game_file(name);
-    LFL::Database::process_game_info(game);
-
-    double time = (clock() - start_time) / CLOCKS_PER_SEC * 1000;  // in ms
-    std::cout << "Processed '" << name << "' in " << time << " ms" << std::endl;
-}
+#include "Ingest.h"
+#include "Utils/Timing.h"
 
 static void help()
 {
@@ -30,6 +22,14 @@ static void help()
                        "Generate statistics to given file."),
         std::make_pair("--max-player <N>",
                        "Truncate generated tables after N-th player."),
+        std::make_pair("--jobs <N>",
+                       "Parse --dir files with N threads (default 1)."),
+        std::make_pair("--batch <N>",
+                       "Commit --dir every N games (default 0, whole dir)."),
+        std::make_pair("--cache <on|off>",
+                       "Cache parsed games next to protocols (default off)."),
+        std::make_pair("--timings <file>",
+                       "Write stage timings of following commands as JSON."),
     };
 
     for (auto &o : options) {
@@ -52,52 +52,96 @@ int main(int argc, char *argv[])
     }
 
     size_t truncate_after = 0;
-
-    for (size_t i = 0; i < args.size(); i++) {
-        if (args[i] == "--help") {
-            help();
-            return 0;
-        }
-
-        // All other commands expect next token
-        if (i + 1 >= args.size()) {
-            std::cout << "One more token expected!" << std::endl;
-            std::cout << "Run --help to list all options!" << std::endl;
-            return 1;
-        }
-
-        const std::string &next_token = args[i + 1];
-
-        if (args[i] == "--single") {
-            process_single_xml_file(next_token);
+    size_t jobs = 1;
+    size_t batch_size = 0;
+    bool use_cache = false;
+    std::string timings_file;
+
+    // Written on every exit, profile of failed run is needed the most
+    struct TimingsWriter {
+        const std::string &file;
+        ~TimingsWriter()
+        {
+            if (file.empty())
+                return;
+            std::ofstream ofs(file);
+            LFL::Utils::Timings::instance().write_json(ofs);
         }
-        else if (args[i] == "--dir") {
-            const std::filesystem::path dir{next_token};
+    } timings_writer{timings_file};
+
+    // Opened on first use, and reused by all following commands
+    std::optional<LFL::Database::Session> session;
+    auto database = [&session]() -> LFL::Database::Session & {
+        if (!session)
+            session.emplace();
+        return *session;
+    };
 
-            for (auto const &dir_entry :
-                 std::filesystem::directory_iterator{dir}) {
-                if (dir_entry.path().extension() == ".xml") {
-                    process_single_xml_file(dir_entry.path().string());
-                }
-                else {
-                    std::cout << "Skipping non XML file '" << dir_entry << "'."
-                              << std::endl;
+    try {
+        for (size_t i = 0; i < args.size(); i++) {
+            if (args[i] == "--help") {
+                help();
+                return 0;
+            }
+
+            // All other commands expect next token
+            if (i + 1 >= args.size()) {
+                std::cout << "One more token expected!" << std::endl;
+                std::cout << "Run --help to list all options!" << std::endl;
+                return 1;
+            }
+
+            const std::string &next_token = args[i + 1];
+
+            if (args[i] == "--single") {
+                LFL::Ingest::process_single_xml_file(
+                    database(), next_token, use_cache);
+            }
+            else if (args[i] == "--dir") {
+                LFL::Ingest::process_directory(
+                    database(), next_token, jobs, batch_size, use_cache);
+            }
+            else if (args[i] == "--generate") {
+                LFL::Database::generate_html_output(
+                    database(), next_token, truncate_after);
+            }
+            else if (args[i] == "--max-player") {
+                truncate_after = std::stoul(next_token);
+            }
+            else if (args[i] == "--jobs") {
+                jobs = std::stoul(next_token);
+            }
+            else if (args[i] == "--batch") {
+                batch_size = std::stoul(next_token);
+            }
+            else if (args[i] == "--cache") {
+                if (next_token != "on" and next_token != "off") {
+                    std::cout << "--cache expects 'on' or 'off'!" << std::endl;
+                    return 1;
                 }
-            }  // dir iterator
-        }
-        else if (args[i] == "--generate") {
-            LFL::Database::generate_html_output(next_token, truncate_after);
-        }
-        else if (args[i] == "--max-player") {
-            truncate_after = std::stoul(next_token);
-        }
-        else {
-            std::cout << "Unknown option '" << args[i] << "';" << std::endl;
-            std::cout << "Run --help to list all options!" << std::endl;
-            return 1;
+                use_cache = next_token == "on";
+            }
+            else if (args[i] == "--timings") {
+                timings_file = next_token;
+                LFL::Utils::Timings::instance().enable();
+            }
+            else {
+                std::cout << "Unknown option '" << args[i] << "';" << std::endl;
+                std::cout << "Run --help to list all options!" << std::endl;
+                return 1;
+            }
+
+            i++;  // all comands expect one more tooken
         }
-
-        i++;  // all comands expect one more tooken
+    }
+    catch (const LFL::Ingest::FileError &e) {
+        std::cerr << "Failed to process '" << e.file() << "': " << e.what()
+                  << std::endl;
+        return 1;
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Failed: " << e.what() << std::endl;
+        return 1;
     }
 
     return 0;